@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "util.h"
+#include "packet_format.h"
+
+namespace util {
+
+// One decoded packet, as logged.
+template <typename Format>
+struct Packet {
+    int64_t arrivalUs;
+    Values<Format> values;
+};
+
+/**
+ * @brief Writes packets to csv files on a thread of its own, so that disk writes do not hold up reading.
+ *
+ * Each device has its own file; `merged`, if given, also gets the packets of every device, with a
+ * Device column, ordered by arrival time. Packets are stamped on one clock with the time their
+ * first byte arrived, so a batch handed over later can hold packets older than another device's
+ * last. Each device's packets must come in order of time; a merged row is written once every
+ * device has handed over a later packet, or has handed over nothing for `mergeWindow`.
+ *
+ * Rows are not flushed one by one: a file's buffer goes to disk when it is full, and at least
+ * every `flushInterval`. At most `maxPending` packets wait to be written; a serial port cannot be
+ * told to slow down, so batches beyond that are dropped and counted instead of piling up in memory.
+ *
+ * If `latenciesUs` is given, the time from each packet's arrival to its row being flushed (its
+ * merged row, with `merged`) is appended to it (by the writer thread; read it after stop()).
+ */
+template <typename Format>
+class CsvWriter {
+public:
+    CsvWriter(std::vector<std::ofstream>& files, std::vector<std::string> names, std::ofstream* merged = nullptr,
+              std::vector<uint32_t>* latenciesUs = nullptr, size_t maxPending = 1 << 20,
+              std::chrono::milliseconds flushInterval = std::chrono::milliseconds(100),
+              std::chrono::milliseconds mergeWindow = std::chrono::milliseconds(200))
+        : files_(files), names_(std::move(names)), merged_(merged), latenciesUs_(latenciesUs), maxPending_(maxPending),
+          flushInterval_(flushInterval), mergeWindow_(mergeWindow), latestUs_(files.size(), std::numeric_limits<int64_t>::min()),
+          handedOverUs_(files.size(), nowUs()), dropped_(files.size()),
+          work_(boost::asio::make_work_guard(io_)), flushTimer_(io_) {
+        scheduleFlush();
+        thread_ = std::thread([this]() { io_.run(); });
+    }
+
+    ~CsvWriter() { stop(); }
+
+    // Writes whatever has been handed over, then stops.
+    void stop() {
+        if (!thread_.joinable()) {
+            return;
+        }
+        boost::asio::post(io_, [this]() {
+            stopping_ = true;  // the timer may have fired already, with its handler still queued
+            flushTimer_.cancel();
+        });
+        work_.reset();
+        thread_.join();
+        writeMerged(true);
+        flush();
+    }
+
+    // Called from the reading thread.
+    void write(size_t device, std::vector<Packet<Format>> packets) {
+        if (pending_.load(std::memory_order_relaxed) + packets.size() > maxPending_) {
+            dropped_[device].fetch_add(packets.size(), std::memory_order_relaxed);
+            return;
+        }
+        pending_.fetch_add(packets.size(), std::memory_order_relaxed);
+        boost::asio::post(io_, [this, device, packets = std::move(packets)]() {
+            std::ofstream& file = files_[device];
+            for (const Packet<Format>& packet : packets) {
+                file << packet.arrivalUs << ',';
+                writeCsvValues<Format>(file, packet.values);
+                file << '\n';
+                if (latenciesUs_ && !merged_) {
+                    unflushedUs_.push_back(packet.arrivalUs);
+                }
+            }
+            if (merged_) {
+                for (const Packet<Format>& packet : packets) {
+                    mergeQueue_.push_back({packet, device, mergeSequence_++});
+                    std::push_heap(mergeQueue_.begin(), mergeQueue_.end(), laterArrival);
+                }
+                latestUs_[device] = packets.back().arrivalUs;
+                handedOverUs_[device] = nowUs();
+                writeMerged();
+            }
+            pending_.fetch_sub(packets.size(), std::memory_order_relaxed);
+        });
+    }
+
+    uint64_t dropped(size_t device) const { return dropped_[device].load(std::memory_order_relaxed); }
+
+private:
+    struct MergedRow {
+        Packet<Format> packet;
+        size_t device;
+        uint64_t sequence;  // packets with the same time keep the order they were handed over in
+    };
+
+    static bool laterArrival(const MergedRow& a, const MergedRow& b) {
+        return a.packet.arrivalUs != b.packet.arrivalUs ? a.packet.arrivalUs > b.packet.arrivalUs : a.sequence > b.sequence;
+    }
+
+    static int64_t nowUs() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Writes the merged rows no packet still to come can go before, or all of them, oldest first.
+    void writeMerged(bool all = false) {
+        int64_t untilUs = std::numeric_limits<int64_t>::max();
+        int64_t quietSinceUs = nowUs() - std::chrono::duration_cast<std::chrono::microseconds>(mergeWindow_).count();
+        for (size_t device = 0; device < latestUs_.size() && !all; ++device) {
+            if (handedOverUs_[device] >= quietSinceUs) {
+                untilUs = std::min(untilUs, latestUs_[device]);
+            }
+        }
+        while (!mergeQueue_.empty() && mergeQueue_.front().packet.arrivalUs <= untilUs) {
+            std::pop_heap(mergeQueue_.begin(), mergeQueue_.end(), laterArrival);
+            const MergedRow& row = mergeQueue_.back();
+            *merged_ << row.packet.arrivalUs << ',' << names_[row.device] << ',';
+            writeCsvValues<Format>(*merged_, row.packet.values);
+            *merged_ << '\n';
+            if (latenciesUs_) {
+                unflushedUs_.push_back(row.packet.arrivalUs);
+            }
+            mergeQueue_.pop_back();
+        }
+    }
+
+    // A packet's latency ends here, once its rows are on their way to disk.
+    void flush() {
+        for (std::ofstream& file : files_) {
+            file.flush();
+        }
+        if (merged_) {
+            merged_->flush();
+        }
+        if (!unflushedUs_.empty()) {
+            int64_t now = nowUs();
+            for (int64_t arrivalUs : unflushedUs_) {
+                latenciesUs_->push_back(static_cast<uint32_t>(now - arrivalUs));
+            }
+            unflushedUs_.clear();
+        }
+    }
+
+    void scheduleFlush() {
+        flushTimer_.expires_after(flushInterval_);
+        flushTimer_.async_wait([this](const boost::system::error_code& error) {
+            if (!error && !stopping_) {
+                if (merged_) {
+                    writeMerged();  // devices may have gone quiet
+                }
+                flush();
+                scheduleFlush();
+            }
+        });
+    }
+
+    std::vector<std::ofstream>& files_;
+    std::vector<std::string> names_;
+    std::ofstream* merged_;
+    std::vector<uint32_t>* latenciesUs_;
+    size_t maxPending_;
+    std::chrono::milliseconds flushInterval_;
+    std::chrono::milliseconds mergeWindow_;
+    // on the writer thread
+    std::vector<int64_t> latestUs_;  // arrival of each device's last packet
+    std::vector<int64_t> handedOverUs_;  // when each device last handed packets over
+    std::vector<MergedRow> mergeQueue_;  // heap, earliest arrival first
+    uint64_t mergeSequence_ = 0;
+    std::vector<int64_t> unflushedUs_;  // arrival of the packets written since the last flush, with latenciesUs
+    std::atomic<size_t> pending_{0};
+    std::vector<std::atomic<uint64_t>> dropped_;  // per device
+    bool stopping_ = false;  // on the writer thread
+    boost::asio::io_context io_;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_;
+    boost::asio::steady_timer flushTimer_;
+    std::thread thread_;
+};
+
+}  // namespace util
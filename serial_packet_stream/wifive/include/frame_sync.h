@@ -0,0 +1,135 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "packet_format.h"
+
+namespace util {
+
+/**
+ * @brief Cuts packets out of a serial byte stream, however the bytes are split across reads.
+ *
+ * Whatever the port has is read in one go into a ring buffer (writeSpan/commit), then every
+ * complete packet in it is extracted. A packet cut by the end of a read stays in the ring until
+ * the next one completes it. The preamble is searched with memchr, so noise between packets is
+ * skipped in bulk rather than byte by byte. Packets are described by `Format` (see packet_format.h).
+ */
+template <typename Format>
+class FrameSynchronizer {
+public:
+    static constexpr size_t packet_size = Format::size;
+
+    // `capacity` must be a power of two, and larger than one read plus a packet.
+    explicit FrameSynchronizer(size_t capacity = 1 << 16) : buffer_(capacity), mask_(capacity - 1) {}
+
+    // Free space to read into: up to the end of the buffer, the rest wraps to the front.
+    std::pair<uint8_t*, size_t> writeSpan() {
+        size_t start = tail_ & mask_;
+        return {buffer_.data() + start, std::min(buffer_.size() - size(), buffer_.size() - start)};
+    }
+
+    // Makes `count` bytes read into writeSpan() available to extract().
+    void commit(size_t count) { tail_ += count; }
+
+    // Calls `onPacket(std::span<const uint8_t, packet_size>)` for every complete packet buffered, in
+    // order; the bytes are valid during the call only, and size() counts them and every byte read
+    // after them. Returns the number of packets.
+    template <typename OnPacket>
+    size_t extract(OnPacket&& onPacket) {
+        size_t packets = 0;
+        while (size() > 0) {
+            size_t skipped = find(Format::preamble[0]);
+            discard(skipped);
+            if (size() < Format::preamble.size()) {
+                break;  // nothing, or the start of a preamble whose rest is still to come
+            }
+            if (!preambleAtHead()) {
+                discard(1);
+                continue;
+            }
+            if (size() < packet_size) {
+                break;
+            }
+            std::span<const uint8_t, packet_size> packet(contiguous(packet_size), packet_size);
+            if (!checksumMatches<Format>(packet)) {
+                // may have been a preamble by chance: look for the next one from the byte after
+                ++checksumErrors_;
+                discard(1);
+                continue;
+            }
+            onPacket(packet);
+            head_ += packet_size;
+            discarding_ = false;
+            ++packets;
+        }
+        return packets;
+    }
+
+    size_t size() const { return tail_ - head_; }
+    uint64_t checksumErrors() const { return checksumErrors_; }
+    uint64_t discardedBytes() const { return discarded_; }  // outside any valid packet
+    uint64_t resyncs() const { return resyncs_; }  // runs of discarded bytes, each ended by a packet (or still going)
+
+private:
+    uint8_t at(size_t offset) const { return buffer_[(head_ + offset) & mask_]; }
+
+    bool preambleAtHead() const {
+        for (size_t i = 1; i < Format::preamble.size(); ++i) {
+            if (at(i) != Format::preamble[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void discard(size_t count) {
+        if (count > 0 && !discarding_) {
+            ++resyncs_;
+            discarding_ = true;
+        }
+        head_ += count;
+        discarded_ += count;
+    }
+
+    // Offset of the first `byte` from the head, size() if there is none.
+    size_t find(uint8_t byte) const {
+        size_t start = head_ & mask_;
+        size_t first = std::min(size(), buffer_.size() - start);
+        if (const void* found = std::memchr(buffer_.data() + start, byte, first)) {
+            return static_cast<const uint8_t*>(found) - (buffer_.data() + start);
+        }
+        if (const void* found = std::memchr(buffer_.data(), byte, size() - first)) {
+            return first + (static_cast<const uint8_t*>(found) - buffer_.data());
+        }
+        return size();
+    }
+
+    // The next `length` bytes in one piece, copied only if they wrap around the end of the buffer.
+    const uint8_t* contiguous(size_t length) {
+        size_t start = head_ & mask_;
+        if (start + length <= buffer_.size()) {
+            return buffer_.data() + start;
+        }
+        size_t first = buffer_.size() - start;
+        std::memcpy(wrapped_.data(), buffer_.data() + start, first);
+        std::memcpy(wrapped_.data() + first, buffer_.data(), length - first);
+        return wrapped_.data();
+    }
+
+    std::vector<uint8_t> buffer_;
+    size_t mask_;
+    size_t head_ = 0;  // both only ever grow, positions are taken modulo the capacity
+    size_t tail_ = 0;
+    std::array<uint8_t, packet_size> wrapped_;
+    uint64_t checksumErrors_ = 0;
+    uint64_t discarded_ = 0;
+    uint64_t resyncs_ = 0;
+    bool discarding_ = false;  // since the last packet
+};
+
+}  // namespace util
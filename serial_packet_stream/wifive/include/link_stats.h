@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace util {
+
+// Mean, standard deviation and extremes of a series, updated one value at a time (Welford).
+struct RunningStats {
+    uint64_t count = 0;
+    double mean = 0;
+    double m2 = 0;  // sum of squared differences from the mean
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+
+    void add(double value) {
+        ++count;
+        double delta = value - mean;
+        mean += delta / count;
+        m2 += delta * (value - mean);
+        min = std::min(min, value);
+        max = std::max(max, value);
+    }
+
+    double stddev() const { return count > 1 ? std::sqrt(m2 / (count - 1)) : 0; }
+};
+
+/**
+ * @brief Health of one serial link: what arrived, what had to be thrown away, and how regularly.
+ *
+ * Bytes discarded between packets and resyncs point at the wire or the USB adapter (corruption,
+ * lost bytes), long gaps between otherwise clean packets at the radio, and large reads with bursty
+ * intervals at the host falling behind and the OS buffering for it.
+ */
+struct LinkStats {
+    uint64_t reads = 0;
+    uint64_t bytes = 0;
+    uint64_t maxRead = 0;         // bytes in the largest read
+    uint64_t packets = 0;
+    uint64_t checksumErrors = 0;
+    uint64_t resyncs = 0;         // times a packet boundary had to be searched for again
+    uint64_t discardedBytes = 0;  // outside any valid packet
+    uint64_t dropped = 0;         // packets the csv writer could not keep up with
+    RunningStats intervalsUs;     // between consecutive packets
+    int64_t lastArrivalUs = -1;
+
+    void addRead(size_t size) {
+        ++reads;
+        bytes += size;
+        maxRead = std::max<uint64_t>(maxRead, size);
+    }
+
+    void addPacket(int64_t arrivalUs) {
+        ++packets;
+        if (lastArrivalUs >= 0) {
+            intervalsUs.add(static_cast<double>(arrivalUs - lastArrivalUs));
+        }
+        lastArrivalUs = arrivalUs;
+    }
+};
+
+}  // namespace util
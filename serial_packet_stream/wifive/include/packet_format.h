@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string>
+#include <utility>
+
+#include "util.h"
+
+namespace util {
+
+/*
+ * A packet format is described by a struct of constexpr members, e.g. Wifive in vendors.h:
+ *   name       selects it at run time (--vendor)
+ *   directory  its logs go to logs/serial_packet/<directory>
+ *   preamble   std::array<uint8_t, N>, the bytes every packet starts with
+ *   size       bytes per packet, preamble and checksum included
+ *   order      std::endian of the multi-byte fields
+ *   checksum   Checksum
+ *   fields     std::array<Field, N>, logged as csv columns in this order
+ * Everything below is instantiated per format, so a parser knows every offset and type at compile time.
+ */
+
+enum class FieldType { u8, i8, u16, i16, u32, i32, f32 };
+
+enum class Checksum {
+    none,
+    xor8  // XOR of every byte before it, in the last byte of the packet
+};
+
+struct Field {
+    const char* name;
+    FieldType type;
+    size_t offset;  // from the first preamble byte
+};
+
+constexpr size_t fieldSize(FieldType type) {
+    switch (type) {
+        case FieldType::u8: case FieldType::i8: return 1;
+        case FieldType::u16: case FieldType::i16: return 2;
+        default: return 4;
+    }
+}
+
+constexpr bool isInteger(FieldType type) { return type != FieldType::f32; }
+
+// Decoded field values, whatever their type on the wire: a double holds every one of them exactly.
+template <typename Format>
+using Values = std::array<double, Format::fields.size()>;
+
+// Fields must lie between the preamble and the checksum.
+template <typename Format>
+constexpr bool validFormat() {
+    constexpr size_t end = Format::size - (Format::checksum == Checksum::none ? 0 : 1);
+    if (Format::preamble.empty() || Format::preamble.size() > end) {
+        return false;
+    }
+    for (const Field& field : Format::fields) {
+        if (field.offset < Format::preamble.size() || field.offset + fieldSize(field.type) > end) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Format>
+bool checksumMatches(std::span<const uint8_t, Format::size> packet) {
+    if constexpr (Format::checksum == Checksum::xor8) {
+        return calculateChecksum(packet.first(Format::size - 1)) == packet[Format::size - 1];
+    } else {
+        return true;
+    }
+}
+
+namespace detail {
+
+template <typename T, typename Format, size_t I>
+double readField(std::span<const uint8_t> packet) {
+    return static_cast<double>(readValue<T, Format::order>(packet, Format::fields[I].offset));
+}
+
+template <typename Format, size_t I>
+double decodeField(std::span<const uint8_t> packet) {
+    constexpr FieldType type = Format::fields[I].type;
+    if constexpr (type == FieldType::u8) return readField<uint8_t, Format, I>(packet);
+    else if constexpr (type == FieldType::i8) return readField<int8_t, Format, I>(packet);
+    else if constexpr (type == FieldType::u16) return readField<uint16_t, Format, I>(packet);
+    else if constexpr (type == FieldType::i16) return readField<int16_t, Format, I>(packet);
+    else if constexpr (type == FieldType::u32) return readField<uint32_t, Format, I>(packet);
+    else if constexpr (type == FieldType::i32) return readField<int32_t, Format, I>(packet);
+    else return readField<float, Format, I>(packet);
+}
+
+template <typename Format, size_t I>
+void encodeField(std::span<uint8_t> packet, double value) {
+    constexpr FieldType type = Format::fields[I].type;
+    constexpr size_t offset = Format::fields[I].offset;
+    if constexpr (type == FieldType::u8) writeValue<uint8_t, Format::order>(packet, offset, static_cast<uint8_t>(value));
+    else if constexpr (type == FieldType::i8) writeValue<int8_t, Format::order>(packet, offset, static_cast<int8_t>(value));
+    else if constexpr (type == FieldType::u16) writeValue<uint16_t, Format::order>(packet, offset, static_cast<uint16_t>(value));
+    else if constexpr (type == FieldType::i16) writeValue<int16_t, Format::order>(packet, offset, static_cast<int16_t>(value));
+    else if constexpr (type == FieldType::u32) writeValue<uint32_t, Format::order>(packet, offset, static_cast<uint32_t>(value));
+    else if constexpr (type == FieldType::i32) writeValue<int32_t, Format::order>(packet, offset, static_cast<int32_t>(value));
+    else writeValue<float, Format::order>(packet, offset, static_cast<float>(value));
+}
+
+template <typename Format, size_t... I>
+Values<Format> decode(std::span<const uint8_t, Format::size> packet, std::index_sequence<I...>) {
+    return Values<Format>{decodeField<Format, I>(packet)...};
+}
+
+template <typename Format, size_t... I>
+void encode(std::span<uint8_t, Format::size> packet, const Values<Format>& values, std::index_sequence<I...>) {
+    (encodeField<Format, I>(packet, values[I]), ...);
+}
+
+}  // namespace detail
+
+// Field values of a packet that passed checksumMatches().
+template <typename Format>
+Values<Format> decode(std::span<const uint8_t, Format::size> packet) {
+    static_assert(validFormat<Format>(), "fields must lie between the preamble and the checksum");
+    return detail::decode<Format>(packet, std::make_index_sequence<Format::fields.size()>());
+}
+
+// The packet carrying `values`, preamble and checksum included (as a device would send it).
+template <typename Format>
+std::array<uint8_t, Format::size> encode(const Values<Format>& values) {
+    static_assert(validFormat<Format>(), "fields must lie between the preamble and the checksum");
+    std::array<uint8_t, Format::size> packet{};
+    std::copy(Format::preamble.begin(), Format::preamble.end(), packet.begin());
+    detail::encode<Format>(packet, values, std::make_index_sequence<Format::fields.size()>());
+    if constexpr (Format::checksum == Checksum::xor8) {
+        packet[Format::size - 1] = calculateChecksum(std::span<const uint8_t>(packet.data(), Format::size - 1));
+    }
+    return packet;
+}
+
+// Field names, comma separated, e.g. "X,Y,Z".
+template <typename Format>
+std::string csvColumns() {
+    std::string columns;
+    for (const Field& field : Format::fields) {
+        columns += (columns.empty() ? "" : ",") + std::string(field.name);
+    }
+    return columns;
+}
+
+// Writes `values` comma separated, each as its wire type would print (floats with float precision).
+template <typename Format>
+void writeCsvValues(std::ostream& out, const Values<Format>& values) {
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i > 0) {
+            out << ',';
+        }
+        if (isInteger(Format::fields[i].type)) {
+            out << static_cast<int64_t>(values[i]);
+        } else {
+            out << static_cast<float>(values[i]);
+        }
+    }
+}
+
+}  // namespace util
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "util.h"
+#include "packet_format.h"
+#include "frame_sync.h"
+#include "link_stats.h"
+#include "csv_writer.h"
+
+namespace util {
+
+// Link statistics of one device, printed once a second and summed up at the end, in place of printing every packet.
+struct ParserStatus {
+    std::string name;  // of the device, printed in front of its lines when there are several
+    uint64_t dumpEvery = 0;  // print every n-th packet in full, 0 for none
+    std::vector<double> latest;  // field values of the last packet
+    LinkStats link;  // since the start
+    RunningStats recentIntervalsUs;  // since the last print
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t lastPackets = 0;
+    std::chrono::steady_clock::time_point lastPrint = start;
+
+    void addPacket(int64_t arrivalUs) {
+        if (link.lastArrivalUs >= 0) {
+            recentIntervalsUs.add(static_cast<double>(arrivalUs - link.lastArrivalUs));
+        }
+        link.addPacket(arrivalUs);
+    }
+
+    // Prints packets/s, link errors, packet interval and jitter, and the latest values at most once per `period`.
+    void print(std::chrono::milliseconds period = std::chrono::milliseconds(1000)) {
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastPrint < period) {
+            return;
+        }
+        double seconds = std::chrono::duration<double>(now - lastPrint).count();
+        std::ostringstream line;
+        if (!name.empty()) {
+            line << name << ": ";
+        }
+        line << std::fixed << std::setprecision(1) << (link.packets - lastPackets) / seconds << " packets/s"
+             << " | packets: " << link.packets << ", checksum errors: " << link.checksumErrors
+             << ", resyncs: " << link.resyncs << ", discarded: " << link.discardedBytes << " bytes";
+        if (link.dropped) {
+            line << ", dropped: " << link.dropped;
+        }
+        if (recentIntervalsUs.count > 0) {
+            line << " | interval: " << std::setprecision(2) << recentIntervalsUs.mean / 1000
+                 << " ms, jitter " << recentIntervalsUs.stddev() / 1000 << " ms";
+        }
+        line << " | latest: " << std::setprecision(3);
+        for (size_t i = 0; i < latest.size(); ++i) {
+            line << (i ? ", " : "") << latest[i];
+        }
+        std::cout << line.str() << std::endl;
+        lastPackets = link.packets;
+        lastPrint = now;
+        recentIntervalsUs = RunningStats();
+    }
+
+    // Everything since the start, once reading has stopped.
+    void printSummary() const {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << "Summary" << (name.empty() ? "" : " of " + name) << ": " << seconds << " s, "
+            << link.packets << " packets (" << link.packets / seconds << "/s), "
+            << link.bytes << " bytes in " << link.reads << " reads (largest " << link.maxRead << ")\n"
+            << "  checksum errors: " << link.checksumErrors << ", resyncs: " << link.resyncs
+            << ", discarded: " << link.discardedBytes << " bytes ("
+            << std::setprecision(2) << (link.bytes ? 100.0 * link.discardedBytes / link.bytes : 0.0) << "%)"
+            << ", dropped by the writer: " << link.dropped << "\n";
+        if (link.intervalsUs.count > 0) {
+            out << std::setprecision(3) << "  interval between packets: mean " << link.intervalsUs.mean / 1000
+                << " ms, jitter (std dev) " << link.intervalsUs.stddev() / 1000 << " ms, min " << link.intervalsUs.min / 1000
+                << " ms, max " << link.intervalsUs.max / 1000 << " ms\n";
+        }
+        std::cout << out.str() << std::flush;
+    }
+};
+
+/**
+ * @brief Reads one serial port asynchronously and hands the packets of every read to a CsvWriter.
+ *
+ * The next read is started before the bytes of the last one are parsed: the two use different
+ * parts of the synchronizer's ring, which acts as a double buffer. Many readers (and timers) can
+ * share one io_context and thread.
+ *
+ * Each read is stamped on the monotonic clock when it completes, i.e. about when its last byte
+ * arrived. A packet is stamped with the time its first byte started on the wire, back-computed from
+ * the bytes that followed it at `baudRate` (bitsPerByte per byte), so packets sharing a read, or
+ * split across two, keep their own time. This assumes the bytes of a read came in back to back, as
+ * they do while the reader keeps up; if they waited in the OS instead, a packet is still stamped no
+ * earlier than the end of the one before it. A `baudRate` of 0 stamps every packet with its read.
+ */
+template <typename Format>
+class SerialReader {
+public:
+    SerialReader(boost::asio::serial_port& serial, size_t device, unsigned int baudRate, CsvWriter<Format>& writer,
+                 ParserStatus& status)
+        : serial_(serial), device_(device), byteTimeNs_(baudRate ? 1e9 * bitsPerByte / baudRate : 0), writer_(writer),
+          status_(status) {
+        status_.latest.resize(Format::fields.size());
+    }
+
+    // Reads until the port fails, then calls `onFailure` and reads no more.
+    void start(std::function<void()> onFailure) {
+        onFailure_ = std::move(onFailure);
+        read();
+    }
+
+    bool failed() const { return failed_; }
+
+private:
+    void read() {
+        auto span = sync_.writeSpan();
+        serial_.async_read_some(boost::asio::buffer(span.first, span.second),
+                                [this](const boost::system::error_code& error, size_t received) { onRead(error, received); });
+    }
+
+    void onRead(const boost::system::error_code& error, size_t received) {
+        if (error) {
+            if (error != boost::asio::error::operation_aborted) {
+                std::cerr << "Error" << (status_.name.empty() ? "" : " on " + status_.name) << ": " << error.message() << std::endl;
+                failed_ = true;
+                onFailure_();
+            }
+            return;
+        }
+        auto readTime = std::chrono::steady_clock::now();
+        sync_.commit(received);
+        status_.link.addRead(received);
+        read();
+
+        auto readNs = std::chrono::duration_cast<std::chrono::nanoseconds>(readTime.time_since_epoch()).count();
+        std::vector<Packet<Format>> packets;
+        sync_.extract([&](std::span<const uint8_t, Format::size> data) {
+            // the packet and every byte after it were on the wire before the read completed, and
+            // after the packet before it
+            int64_t packetNs = std::llround(Format::size * byteTimeNs_);
+            int64_t firstByteNs = readNs - std::llround(sync_.size() * byteTimeNs_);
+            lastFirstByteNs_ = std::min(std::max(firstByteNs, lastFirstByteNs_ + packetNs), readNs - packetNs);
+            int64_t micros = lastFirstByteNs_ / 1000;
+            Packet<Format> packet{micros, decode<Format>(data)};
+            packets.push_back(packet);
+            status_.addPacket(micros);
+            std::copy(packet.values.begin(), packet.values.end(), status_.latest.begin());
+            if (status_.dumpEvery && status_.link.packets % status_.dumpEvery == 0) {
+                std::cout << (status_.name.empty() ? "" : status_.name + " ") << "Data: ";
+                for (size_t i = 0; i < packet.values.size(); ++i) {
+                    std::cout << (i ? ", " : "") << packet.values[i];
+                }
+                std::cout << " | micros: " << micros << " us" << std::endl;
+            }
+        });
+        status_.link.checksumErrors = sync_.checksumErrors();
+        status_.link.resyncs = sync_.resyncs();
+        status_.link.discardedBytes = sync_.discardedBytes();
+        status_.link.dropped = writer_.dropped(device_);
+        if (!packets.empty()) {
+            writer_.write(device_, std::move(packets));
+        }
+    }
+
+    boost::asio::serial_port& serial_;
+    size_t device_;
+    double byteTimeNs_;  // on the wire
+    int64_t lastFirstByteNs_ = std::numeric_limits<int64_t>::min() / 2;  // of the last packet
+    CsvWriter<Format>& writer_;
+    ParserStatus& status_;
+    FrameSynchronizer<Format> sync_;
+    std::function<void()> onFailure_;
+    bool failed_ = false;
+};
+
+}  // namespace util
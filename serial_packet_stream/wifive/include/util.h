@@ -1,61 +1,57 @@
-#include <vector>
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <utility>  // before asio: Boost 1.74's awaitable.hpp uses std::exchange without it in C++20
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 
 #define VERBOSE
-#define CHECKSUM
 
 namespace util {
 
-#ifdef CHECKSUM
-const int packet_size = 15;  // 14 bytes + 1 for checksum
-#else
-const int packet_size = 14;
-#endif
-
-typedef union {
-    float f;
-    uint8_t b[4];
-} FloatUnion;
-
-std::vector<uint8_t> floatToBytes(float value) {
-    FloatUnion u;
-    u.f = value;
-#ifdef BIG_ENDIAN
-    return std::vector<uint8_t>(u.b + 4, u.b);
-#else // Little endian, default
-    return std::vector<uint8_t>(u.b, u.b + 4);
-#endif
+// Multi-byte values travel in the byte order their packet format says; this machine's is known at compile time.
+static_assert(std::endian::native == std::endian::little || std::endian::native == std::endian::big,
+              "mixed-endian machines are not supported");
+
+// Reads the T stored in byte order `order` at `bytes[start]`.
+template <typename T, std::endian order = std::endian::little>
+T readValue(std::span<const uint8_t> bytes, size_t start) {
+    std::array<uint8_t, sizeof(T)> value;
+    std::memcpy(value.data(), bytes.data() + start, value.size());
+    if constexpr (order != std::endian::native) {
+        std::reverse(value.begin(), value.end());
+    }
+    return std::bit_cast<T>(value);
 }
 
-float bytesToFloat(const std::vector<uint8_t>& bytes, int start) {
-    FloatUnion u;
-
-#ifdef BIG_ENDIAN
-    u.b[0] = bytes[start + 3];
-    u.b[1] = bytes[start + 2];
-    u.b[2] = bytes[start + 1];
-    u.b[3] = bytes[start];
-#else // Little endian, default
-    u.b[0] = bytes[start];
-    u.b[1] = bytes[start + 1];
-    u.b[2] = bytes[start + 2];
-    u.b[3] = bytes[start + 3];
-#endif
-
-    return u.f;
+// Stores `value` in byte order `order` at `bytes[start]`.
+template <typename T, std::endian order = std::endian::little>
+void writeValue(std::span<uint8_t> bytes, size_t start, T value) {
+    auto raw = std::bit_cast<std::array<uint8_t, sizeof(T)>>(value);
+    if constexpr (order != std::endian::native) {
+        std::reverse(raw.begin(), raw.end());
+    }
+    std::memcpy(bytes.data() + start, raw.data(), raw.size());
 }
 
 // Function to calculate checksum (XOR of all bytes)
-uint8_t calculateChecksum(const std::vector<uint8_t>& data) {
+inline uint8_t calculateChecksum(std::span<const uint8_t> data) {
     uint8_t checksum = 0;
-    for (const auto& byte : data) {
+    for (uint8_t byte : data) {
         checksum ^= byte;
     }
     return checksum;
 }
 
-void setupSerialPort(boost::asio::io_service& io, boost::asio::serial_port& serial, const std::string& port, unsigned int baudRate) {
+// Start bit, 8 data bits and one stop bit, as setupSerialPort() configures the port.
+constexpr unsigned int bitsPerByte = 10;
+
+inline void setupSerialPort(boost::asio::io_context& io, boost::asio::serial_port& serial, const std::string& port, unsigned int baudRate) {
     serial.open(port);
     serial.set_option(boost::asio::serial_port_base::baud_rate(baudRate));
     serial.set_option(boost::asio::serial_port_base::character_size(8));
@@ -64,4 +60,4 @@ void setupSerialPort(boost::asio::io_service& io, boost::asio::serial_port& seri
     serial.set_option(boost::asio::serial_port_base::flow_control(boost::asio::serial_port_base::flow_control::none));
 }
 
-}  // namespace util
\ No newline at end of file
+}  // namespace util
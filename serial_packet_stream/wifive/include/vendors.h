@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+
+#include "packet_format.h"
+
+namespace util {
+
+// Wifive UWB tag: position as three little-endian floats after the preamble, then an XOR checksum.
+struct Wifive {
+    static constexpr const char* name = "wifive";
+    static constexpr const char* directory = "wifive";
+    static constexpr std::array<uint8_t, 2> preamble{0x59, 0x35};
+    static constexpr size_t size = 15;
+    static constexpr std::endian order = std::endian::little;
+    static constexpr Checksum checksum = Checksum::xor8;
+    static constexpr std::array<Field, 3> fields{{
+        {"X", FieldType::f32, 2},
+        {"Y", FieldType::f32, 6},
+        {"Z", FieldType::f32, 10},
+    }};
+};
+
+// Wifive firmware configured without the checksum byte.
+struct WifiveNoChecksum : Wifive {
+    static constexpr const char* name = "wifive-nochecksum";
+    static constexpr size_t size = 14;
+    static constexpr Checksum checksum = Checksum::none;
+};
+
+template <typename... Formats>
+struct FormatList {};
+
+// Every format the parser and talker can be run with (--vendor); the first is the default.
+// A new vendor needs a descriptor above and its entry here.
+using Vendors = FormatList<Wifive, WifiveNoChecksum>;
+
+}  // namespace util
@@ -0,0 +1,100 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <new>
+#include <cstdlib>
+
+#include "util.h"
+#include "frame_sync.h"
+#include "vendors.h"
+
+// Cost of encoding Wifive packets (as the talker does) and of finding and decoding them in a byte
+// stream (as the parser does), per packet: time and heap allocations. "vectors" decodes the way the
+// parser once did, with a vector per packet and another for its checksum, for comparison.
+
+using Format = util::Wifive;
+
+static size_t g_allocations = 0;
+
+// Every replaceable form of new and delete goes through the same counted malloc/free pair.
+static void* countedAllocate(size_t size) {
+    ++g_allocations;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size) { return countedAllocate(size); }
+void* operator new[](size_t size) { return countedAllocate(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+void report(const char* name, size_t packets, double nanoseconds, size_t allocations, float sum) {
+    std::cout << "  " << std::setw(14) << std::left << name << std::right
+              << std::setw(8) << std::fixed << std::setprecision(1) << nanoseconds / packets << " ns/packet"
+              << std::setw(8) << std::setprecision(2) << static_cast<double>(allocations) / packets << " allocs/packet"
+              << "  (sum " << std::setprecision(0) << sum << ")\n";
+}
+
+int main(int argc, char* argv[]) {
+    size_t packets = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    const size_t read_size = 4096;  // bytes per read from the port
+
+    std::vector<uint8_t> stream;
+    stream.reserve(packets * Format::size);
+    {
+        size_t allocations = g_allocations;
+        float sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < packets; ++i) {
+            auto packet = util::encode<Format>({i * 0.5f, -(i * 0.25f), i % 1000 + 0.125f});
+            stream.insert(stream.end(), packet.begin(), packet.end());
+            sum += packet[Format::size - 1];
+        }
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        report("encode", packets, elapsed, g_allocations - allocations, sum);
+    }
+
+    {
+        util::FrameSynchronizer<Format> sync;
+        size_t allocations = g_allocations;
+        float sum = 0;
+        size_t found = 0;
+        auto start = std::chrono::steady_clock::now();
+        size_t offset = 0;
+        while (offset < stream.size()) {
+            // like a read from the port: shorter where the ring wraps
+            auto span = sync.writeSpan();
+            size_t length = std::min({read_size, stream.size() - offset, span.second});
+            std::memcpy(span.first, stream.data() + offset, length);
+            sync.commit(length);
+            offset += length;
+            found += sync.extract([&](std::span<const uint8_t, Format::size> packet) {
+                auto values = util::decode<Format>(packet);
+                sum += values[0] + values[1] + values[2];
+            });
+        }
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        report("synchronizer", found, elapsed, g_allocations - allocations, sum);
+    }
+
+    {
+        size_t allocations = g_allocations;
+        float sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t offset = 0; offset + Format::size <= stream.size(); offset += Format::size) {
+            std::vector<uint8_t> buffer(stream.begin() + offset, stream.begin() + offset + Format::size);
+            if (util::calculateChecksum(std::vector<uint8_t>(buffer.begin(), buffer.end() - 1)) == buffer.back()) {
+                sum += util::readValue<float>(buffer, 2) + util::readValue<float>(buffer, 6) + util::readValue<float>(buffer, 10);
+            }
+        }
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        report("vectors", packets, elapsed, g_allocations - allocations, sum);
+    }
+    return 0;
+}
@@ -0,0 +1,351 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "util.h"
+#include "vendors.h"
+#include "csv_writer.h"
+#include "serial_reader.h"
+
+// Loopback harness of the serial path, without hardware: a pseudo-terminal pair stands in for the
+// port. Packets encoded the way the talker sends them, some corrupted or cut short, are written to
+// one end at a sweep of rates; the parser's SerialReader and CsvWriter read the other end and log to
+// a csv file. Each case reports the rates, lost packets, link errors, the parser's CPU use and the
+// latency from a packet's first byte to its row being flushed; all cases are saved as csv.
+//
+// The csv file is read back: a valid packet without its row is lost. An 8-bit checksum passes about
+// one in 256 misframed packets (a cut-short packet and the start of the next one), which swallows the
+// real packet that follows; such rows are counted as false. Beyond the line rate, packets the csv
+// writer cannot keep up with are dropped. Exits with 1 if, at or below the line rate, more packets
+// were lost than false ones explain, so it doubles as an end-to-end test.
+//
+// The reader is given the port's baud rate, so packets are stamped with the time of their first byte:
+// consecutive packets of one read are one packet time apart. The pty delivers faster than the baud
+// rate, so stamps are also held to at least one packet time after the previous one and before their
+// read. The arrival column of the csv file must never run backwards (exits with 1 otherwise), and from
+// the line rate on, where reads carry several packets, steps of exactly one packet time must show up.
+
+using Format = util::Wifive;
+
+double threadCpuSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+double processCpuSeconds() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+std::vector<double> parseList(const std::string& text) {
+    std::vector<double> values;
+    std::stringstream ss(text);
+    for (std::string value; std::getline(ss, value, ',');) {
+        values.push_back(std::stod(value));
+    }
+    return values;
+}
+
+struct Options {
+    std::vector<double> rates;  // packets/s, 0 for as fast as the parser takes them
+    double seconds = 2;  // of sending, per case
+    unsigned int baudRate = 921600;
+    double corrupt = 0.01;  // fraction of packets with a flipped byte
+    double partial = 0.01;  // fraction of packets cut short
+    std::string output = "bench_loopback.csv";
+};
+
+// What the talker side wrote to the port.
+struct Sent {
+    uint64_t packets = 0;
+    uint64_t corrupt = 0;
+    uint64_t partial = 0;
+    double seconds = 0;
+    double cpuSeconds = 0;
+
+    uint64_t valid() const { return packets - corrupt - partial; }
+};
+
+bool writeAll(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// Writes packets to `fd` at `rate` for `seconds`, in 1 ms batches. The pty blocks when the parser
+// falls behind, so unthrottled (rate 0) the parser sets the pace.
+Sent generate(int fd, const Options& options, double rate) {
+    Sent sent;
+    double cpuStart = threadCpuSeconds();
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> chance(0, 1);
+    std::uniform_int_distribution<size_t> payloadByte(Format::preamble.size(), Format::size - 2);
+    std::uniform_int_distribution<size_t> partialLength(1, Format::size - 1);
+    std::vector<uint8_t> batch;
+
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.seconds));
+    for (auto now = start; now < end; now = std::chrono::steady_clock::now()) {
+        uint64_t due = rate > 0 ? static_cast<uint64_t>(rate * std::chrono::duration<double>(now - start).count()) - sent.packets : 256;
+        batch.clear();
+        for (uint64_t i = 0; i < due; ++i, ++sent.packets) {
+            // values that print exactly and can be checked against each other when read back
+            float k = static_cast<float>(sent.packets % 1000);
+            auto packet = util::encode<Format>({k + 0.5f, -k * 0.25f, k + 0.125f});
+            size_t length = Format::size;
+            if (chance(random) < options.corrupt) {
+                packet[payloadByte(random)] ^= 0x5a;
+                ++sent.corrupt;
+            } else if (chance(random) < options.partial) {
+                length = partialLength(random);
+                ++sent.partial;
+            }
+            batch.insert(batch.end(), packet.begin(), packet.begin() + length);
+        }
+        if (!writeAll(fd, batch.data(), batch.size())) {
+            std::cerr << "Error: writing to the pty: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        if (rate > 0) {
+            std::this_thread::sleep_until(now + std::chrono::milliseconds(1));
+        }
+    }
+    sent.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sent.cpuSeconds = threadCpuSeconds() - cpuStart;
+    return sent;
+}
+
+// Rows of the csv file, those carrying values generate() sends, and how their arrival stamps step.
+struct Rows {
+    uint64_t total = 0;
+    uint64_t intact = 0;
+    uint64_t paced = 0;      // one packet time after the previous row, give or take the rounding to us
+    uint64_t backwards = 0;  // before the previous row
+};
+
+Rows readBack(const std::filesystem::path& csvPath, double packetUs) {
+    Rows rows;
+    std::ifstream file(csvPath);
+    std::string line;
+    std::getline(file, line);  // header
+    int64_t previous = 0;
+    while (std::getline(file, line)) {
+        ++rows.total;
+        int64_t arrival;
+        double x, y, z;
+        char comma;
+        std::istringstream fields(line);
+        if (!(fields >> arrival)) {
+            continue;
+        }
+        if (rows.total > 1) {
+            rows.backwards += arrival < previous;
+            rows.paced += std::abs(static_cast<double>(arrival - previous) - packetUs) <= 1;
+        }
+        previous = arrival;
+        if (fields >> comma >> x >> comma >> y >> comma >> z) {
+            double k = x - 0.5;
+            if (k == std::floor(k) && k >= 0 && k < 1000 && y == -k * 0.25 && z == k + 0.125) {
+                ++rows.intact;
+            }
+        }
+    }
+    return rows;
+}
+
+struct Result {
+    double rate;
+    Sent sent;
+    util::LinkStats link;
+    Rows rows;
+    double parserCpuSeconds;
+    std::vector<uint32_t> latenciesUs;  // sorted
+
+    uint64_t lost() const { return sent.valid() > rows.intact ? sent.valid() - rows.intact : 0; }
+    uint64_t falsePackets() const { return rows.total - rows.intact; }
+    double pacedPercent() const { return rows.total > 1 ? 100.0 * rows.paced / (rows.total - 1) : 0.0; }
+    uint32_t latencyPercentile(double p) const {
+        return latenciesUs.empty() ? 0 : latenciesUs[std::min(latenciesUs.size() - 1, static_cast<size_t>(p / 100 * latenciesUs.size()))];
+    }
+};
+
+bool runCase(const Options& options, double rate, const std::filesystem::path& csvPath, Result& result) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        std::cerr << "Error: unable to open a pseudo-terminal: " << std::strerror(errno) << std::endl;
+        if (master >= 0) {
+            ::close(master);
+        }
+        return false;
+    }
+
+    boost::asio::io_context io;
+    boost::asio::serial_port serial(io);
+    try {
+        util::setupSerialPort(io, serial, ptsname(master), options.baudRate);
+    } catch (boost::system::system_error& e) {
+        std::cerr << "Error: " << ptsname(master) << ": " << e.what() << std::endl;
+        ::close(master);
+        return false;
+    }
+
+    std::vector<std::ofstream> files;
+    files.emplace_back(csvPath);
+    files.back() << "ArrivalTimeUs," << util::csvColumns<Format>() << '\n';
+    util::ParserStatus status;
+    result.rate = rate;
+    result.latenciesUs.clear();
+    double cpuStart = processCpuSeconds();
+    {
+        util::CsvWriter<Format> writer(files, {"pty"}, nullptr, &result.latenciesUs);
+        util::SerialReader<Format> reader(serial, 0, options.baudRate, writer, status);
+        reader.start([&io]() { io.stop(); });
+        std::thread parser([&io]() { io.run(); });
+
+        result.sent = generate(master, options, rate);
+        // whatever is still in the pty is read within a few ms
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        io.stop();
+        parser.join();
+        writer.stop();
+        status.link.dropped = writer.dropped(0);
+    }
+    result.parserCpuSeconds = processCpuSeconds() - cpuStart - result.sent.cpuSeconds;
+    result.link = status.link;
+    std::sort(result.latenciesUs.begin(), result.latenciesUs.end());
+    files.clear();
+    result.rows = readBack(csvPath, 1e6 * Format::size * util::bitsPerByte / options.baudRate);
+    serial.close();
+    ::close(master);
+    return true;
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --rates <packets/s,...>  target rates, 0 for as fast as the parser reads\n"
+              << "                           (default 100, 1000, 0.5, 1, 10 and 100 times the line rate, 0)\n"
+              << "  --baud <rate>            baud rate the line rate is derived from, 10 bits per byte (default 921600)\n"
+              << "  --duration <s>           send time per case (default 2)\n"
+              << "  --corrupt <fraction>     packets with a flipped byte (default 0.01)\n"
+              << "  --partial <fraction>     packets cut short (default 0.01)\n"
+              << "  --output <file>          results as csv (default bench_loopback.csv)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    bool ratesGiven = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--rates") {
+            options.rates = parseList(value);
+            ratesGiven = true;
+        } else if (arg == "--baud") {
+            options.baudRate = std::stoul(value);
+        } else if (arg == "--duration") {
+            options.seconds = std::stod(value);
+        } else if (arg == "--corrupt") {
+            options.corrupt = std::stod(value);
+        } else if (arg == "--partial") {
+            options.partial = std::stod(value);
+        } else if (arg == "--output") {
+            options.output = value;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    const double lineRate = static_cast<double>(options.baudRate) / (util::bitsPerByte * Format::size);
+    if (!ratesGiven) {
+        options.rates = {100, 1000, std::floor(lineRate / 2), std::floor(lineRate), std::floor(10 * lineRate),
+                         std::floor(100 * lineRate), 0};
+    }
+    std::cout << "Line rate at " << options.baudRate << " baud: " << std::fixed << std::setprecision(0)
+              << lineRate << " packets/s" << std::endl;
+
+    std::filesystem::path csvPath = std::filesystem::temp_directory_path() / "serial_bench_loopback.csv";
+    std::ofstream report(options.output);
+    report << "target_rate,sent_rate,received_rate,sent,corrupt,partial,received,lost,false_packets,dropped,"
+              "checksum_errors,resyncs,discarded_bytes,reads,parser_cpu_percent,cpu_us_per_packet,latency_p50_us,latency_p99_us,latency_max_us,paced_percent,backwards\n";
+    std::cout << std::setw(10) << "target/s" << std::setw(10) << "sent/s" << std::setw(10) << "recv/s" << std::setw(8) << "lost"
+              << std::setw(7) << "false" << std::setw(9) << "dropped" << std::setw(9) << "cksum" << std::setw(9) << "resyncs" << std::setw(8) << "cpu%" << std::setw(9) << "us/pkt"
+              << std::setw(9) << "p50 us" << std::setw(9) << "p99 us" << std::setw(9) << "max us" << std::setw(8) << "paced%" << std::endl;
+
+    double maxSustained = 0;
+    bool lost = false;
+    bool misstamped = false;
+    Result result;
+    for (double rate : options.rates) {
+        if (!runCase(options, rate, csvPath, result)) {
+            return 1;
+        }
+        double sentRate = result.sent.packets / result.sent.seconds;
+        double receivedRate = result.link.packets / result.sent.seconds;
+        double cpuPercent = 100 * result.parserCpuSeconds / result.sent.seconds;
+        double cpuPerPacket = result.link.packets ? 1e6 * result.parserCpuSeconds / result.link.packets : 0;
+        std::cout << std::setw(10) << (rate > 0 ? std::to_string(static_cast<uint64_t>(rate)) : "max")
+                  << std::setw(10) << std::setprecision(0) << sentRate << std::setw(10) << receivedRate
+                  << std::setw(8) << result.lost() << std::setw(7) << result.falsePackets() << std::setw(9) << result.link.dropped << std::setw(9) << result.link.checksumErrors << std::setw(9) << result.link.resyncs
+                  << std::setw(8) << std::setprecision(1) << cpuPercent << std::setw(9) << std::setprecision(2) << cpuPerPacket
+                  << std::setw(9) << result.latencyPercentile(50) << std::setw(9) << result.latencyPercentile(99)
+                  << std::setw(9) << result.latencyPercentile(100) << std::setw(8) << std::setprecision(1) << result.pacedPercent() << std::endl;
+        report << std::fixed << std::setprecision(1) << rate << ',' << sentRate << ',' << receivedRate << ',' << result.sent.packets << ','
+               << result.sent.corrupt << ',' << result.sent.partial << ',' << result.link.packets << ',' << result.lost() << ',' << result.falsePackets() << ',' << result.link.dropped << ','
+               << result.link.checksumErrors << ',' << result.link.resyncs << ',' << result.link.discardedBytes << ','
+               << result.link.reads << ',' << cpuPercent << ',' << std::setprecision(3) << cpuPerPacket << ','
+               << result.latencyPercentile(50) << ',' << result.latencyPercentile(99) << ',' << result.latencyPercentile(100) << ','
+               << std::setprecision(1) << result.pacedPercent() << ',' << result.rows.backwards << '\n';
+        // every loss explained by a checksum collision
+        bool intact = result.lost() <= result.falsePackets();
+        // and the writer not falling further and further behind: rows wait up to a flush interval (100 ms) anyway
+        if (intact && result.latencyPercentile(99) < 200000) {
+            maxSustained = std::max(maxSustained, receivedRate);
+        }
+        lost = lost || (!intact && rate > 0 && rate <= lineRate);
+        if (result.rows.backwards > 0) {
+            std::cerr << "Error: " << result.rows.backwards << " arrival stamps before the previous row's" << std::endl;
+            misstamped = true;
+        }
+        if ((rate == 0 || rate >= lineRate) && result.rows.paced == 0) {
+            std::cerr << "Error: no packets one packet time apart: stamps are not back-dated by the baud rate" << std::endl;
+            misstamped = true;
+        }
+    }
+    std::filesystem::remove(csvPath);
+
+    std::cout << "Max sustained: " << std::setprecision(0) << maxSustained << " packets/s without loss, p99 latency under 200 ms ("
+              << std::setprecision(1) << maxSustained / lineRate << "x the line rate)" << std::endl;
+    std::cout << "Results saved to " << options.output << std::endl;
+    return lost || misstamped ? 1 : 0;
+}
@@ -1,11 +1,20 @@
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <fstream>
 #include <filesystem>
 #include <iomanip>
+#include <sstream>
 #include <string>
 #include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
 
 #include "util.h"
+#include "vendors.h"
+#include "csv_writer.h"
+#include "serial_reader.h"
 
 std::string get_current_timestamp_filename(const std::string &relative_base_dir="") {
     auto now = std::chrono::system_clock::now();
@@ -15,7 +24,7 @@ std::string get_current_timestamp_filename(const std::string &relative_base_dir=
 #ifdef _WIN32
     localtime_s(&now_tm, &now_c);
 #else
-    localtime_r(&now_c, &now_tm);~
+    localtime_r(&now_c, &now_tm);
 #endif
 
     std::ostringstream date_oss;
@@ -35,75 +44,152 @@ std::string get_current_timestamp_filename(const std::string &relative_base_dir=
     return full_path.string();
 }
 
-void readSerial(boost::asio::serial_port& serial, std::ofstream& csvFile) {
-    std::vector<uint8_t> buffer(util::packet_size);
-    boost::asio::read(serial, boost::asio::buffer(buffer, 1));  // Read one byte at a time
+// Prints the status lines once a second until the io_context stops.
+void printStatus(boost::asio::steady_timer& timer, std::vector<util::ParserStatus>& statuses) {
+    timer.expires_after(std::chrono::seconds(1));
+    timer.async_wait([&timer, &statuses](const boost::system::error_code& error) {
+        if (!error) {
+            for (util::ParserStatus& status : statuses) {
+                status.print();
+            }
+            printStatus(timer, statuses);
+        }
+    });
+}
 
-    if (buffer[0] == 0x59) {
-        boost::asio::read(serial, boost::asio::buffer(buffer.data() + 1, 1));  // Read the second byte
+// Short name of a port for file names and status lines, e.g. COM4 or ttyUSB0.
+std::string deviceName(const std::string& port) {
+    return port.substr(port.find_last_of("/\\") + 1);
+}
 
-        if (buffer[1] == 0x35) {
-            auto arrivalTime = std::chrono::steady_clock::now();
-            boost::asio::read(serial, boost::asio::buffer(buffer.data() + 2, util::packet_size - 2));
+struct Options {
+    std::vector<std::pair<std::string, unsigned int>> devices;  // port, baud rate
+    uint64_t dumpEvery = 0;
+    bool merge = false;
+};
+
+// Captures every device in `options`, whose packets are described by `Format`, until Ctrl+C.
+template <typename Format>
+int capture(const Options& options) {
+    const size_t deviceCount = options.devices.size();
+    boost::asio::io_context io;
+    std::vector<std::unique_ptr<boost::asio::serial_port>> serials;
+    std::vector<std::string> names;
+    for (const auto& [port, baudRate] : options.devices) {
+        serials.push_back(std::make_unique<boost::asio::serial_port>(io));
+        try {
+            util::setupSerialPort(io, *serials.back(), port, baudRate);
+        } catch (boost::system::system_error& e) {
+            std::cerr << "Error: " << port << ": " << e.what() << std::endl;
+            return 1;
+        }
+        names.push_back(deviceName(port));
+        std::cout << "Listening on port " << port << " at " << baudRate << " baud." << std::endl;
+    }
 
-            float x = util::bytesToFloat(buffer, 2);
-            float y = util::bytesToFloat(buffer, 6);
-            float z = util::bytesToFloat(buffer, 10);
-#ifdef CHECKSUM
-            uint8_t receivedChecksum = buffer[14];
-            uint8_t calculatedChecksum = util::calculateChecksum(std::vector<uint8_t>(buffer.begin(), buffer.end() - 1));
-            if (receivedChecksum == calculatedChecksum) {
-#endif
-                auto micros = std::chrono::duration_cast<std::chrono::microseconds>(arrivalTime.time_since_epoch()).count();
-                csvFile << micros << "," << x << "," << y << "," << z << std::endl;
-#ifdef VERBOSE
-                std::cout << "Data: " << x << ", " << y << ", " << z << " | micros: " << micros << " ms" << std::endl;
-#endif
-#ifdef CHECKSUM
-            } else {
-                std::cerr << "Checksum error!" << std::endl;
-            }
-#endif
+    // one device keeps <time>.csv, several get <time>_<device>.csv
+    std::string csv_filename = get_current_timestamp_filename(std::string("../../../../logs/serial_packet/") + Format::directory);
+    std::string csv_base = csv_filename.substr(0, csv_filename.size() - 4);
+    std::vector<std::ofstream> csv_files;
+    for (size_t i = 0; i < deviceCount; ++i) {
+        std::string filename = deviceCount == 1 ? csv_filename : csv_base + "_" + names[i] + ".csv";
+        std::cout << "CSV filename: " << filename << std::endl;
+        csv_files.emplace_back(filename);
+        if (!csv_files.back().is_open()) {
+            std::cerr << "Error: Unable to open CSV file for writing." << std::endl;
+            return 1;
         }
+        csv_files.back() << "ArrivalTimeUs," << util::csvColumns<Format>() << std::endl;
+    }
+    std::ofstream merged_file;
+    if (options.merge) {
+        std::cout << "Merged CSV filename: " << csv_base + "_merged.csv" << std::endl;
+        merged_file.open(csv_base + "_merged.csv");
+        if (!merged_file.is_open()) {
+            std::cerr << "Error: Unable to open CSV file for writing." << std::endl;
+            return 1;
+        }
+        merged_file << "ArrivalTimeUs,Device," << util::csvColumns<Format>() << std::endl;
     }
-}
 
-int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <COM port> <baud rate>" << std::endl;
-        return 1;
+    std::vector<util::ParserStatus> statuses(deviceCount);
+    util::CsvWriter<Format> writer(csv_files, names, options.merge ? &merged_file : nullptr);
+    std::vector<std::unique_ptr<util::SerialReader<Format>>> readers;
+    size_t reading = deviceCount;
+    for (size_t i = 0; i < deviceCount; ++i) {
+        statuses[i].name = deviceCount == 1 ? "" : names[i];
+        statuses[i].dumpEvery = options.dumpEvery;
+        readers.push_back(std::make_unique<util::SerialReader<Format>>(*serials[i], i, options.devices[i].second,
+                                                                    writer, statuses[i]));
+        // the other devices go on when one fails
+        readers.back()->start([&io, &reading]() {
+            if (--reading == 0) {
+                io.stop();
+            }
+        });
     }
 
-    std::string port = argv[1];
-    unsigned int baudRate = std::stoi(argv[2]);
-    boost::asio::io_service io;
-    boost::asio::serial_port serial(io);
+#ifdef VERBOSE
+    boost::asio::steady_timer statusTimer(io);
+    printStatus(statusTimer, statuses);
+#endif
 
-    try {
-        util::setupSerialPort(io, serial, port, baudRate);
-    } catch (boost::system::system_error& e) {
-        std::cerr << "Error: " << e.what() << std::endl;
-        return 1;
+    // Ctrl+C stops reading; the writer then logs what it was handed before the files are closed
+    boost::asio::signal_set signals(io, SIGINT, SIGTERM);
+    signals.async_wait([&io](const boost::system::error_code&, int) { io.stop(); });
+
+    // everything but csv writing runs on this thread
+    io.run();
+    bool failed = false;
+    for (size_t i = 0; i < deviceCount; ++i) {
+        statuses[i].link.dropped = writer.dropped(i);
+        statuses[i].printSummary();
+        failed = failed || readers[i]->failed();
     }
-    std::string csv_filename = get_current_timestamp_filename("../../../../logs/serial_packet/wifive");
-    std::cout << "Listening on port " << port << " at " << baudRate << " baud." << std::endl;
-    std::cout << "CSV filename: " << csv_filename << std::endl;
+    return failed ? 1 : 0;
+}
 
-    std::ofstream csv_file(csv_filename);
-    if (!csv_file.is_open()) {
-        std::cerr << "Error: Unable to open CSV file for writing." << std::endl;
-        return 1;
-    }
-    csv_file << "ArrivalTimeUs,X,Y,Z" << std::endl;
+struct Vendor {
+    const char* name;
+    int (*capture)(const Options&);
+};
 
-    while (true) {
-        try {
-            readSerial(serial, csv_file);
-        } catch (boost::system::system_error& e) {
-            std::cerr << "Error: " << e.what() << std::endl;
-            return 1;
+// One capture<Format> per vendor in util::Vendors, selected by name at run time.
+template <typename... Formats>
+constexpr std::array<Vendor, sizeof...(Formats)> makeRegistry(util::FormatList<Formats...>) {
+    return {Vendor{Formats::name, &capture<Formats>}...};
+}
+
+constexpr auto vendors = makeRegistry(util::Vendors{});
+
+int main(int argc, char* argv[]) {
+    Options options;
+    std::vector<std::string> positional;
+    std::string vendor = vendors[0].name;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--dump-every" && i + 1 < argc) {
+            options.dumpEvery = std::stoul(argv[++i]);
+        } else if (arg == "--merged") {
+            options.merge = true;
+        } else if (arg == "--vendor" && i + 1 < argc) {
+            vendor = argv[++i];
+        } else {
+            positional.push_back(arg);
         }
     }
-
-    return 0;
+    auto selected = std::find_if(vendors.begin(), vendors.end(), [&vendor](const Vendor& v) { return vendor == v.name; });
+    if (positional.empty() || positional.size() % 2 != 0 || selected == vendors.end()) {
+        std::cerr << "Usage: " << argv[0] << " <COM port> <baud rate> [<COM port> <baud rate> ...] [--vendor <name>] [--merged] [--dump-every <n>]\n"
+                  << "Vendors:";
+        for (const Vendor& v : vendors) {
+            std::cerr << " " << v.name;
+        }
+        std::cerr << " (default " << vendors[0].name << ")" << std::endl;
+        return 1;
+    }
+    for (size_t i = 0; i < positional.size(); i += 2) {
+        options.devices.emplace_back(positional[i], std::stoi(positional[i + 1]));
+    }
+    return selected->capture(options);
 }
@@ -1,44 +1,69 @@
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <cstdlib>  // For std::rand()
+#include <thread>
 
 #include "util.h"
+#include "vendors.h"
 
-// Function to send data packet (preamble + 3 floats + checksum)
-void sendPacket(boost::asio::serial_port& serial, float val1, float val2, float val3) {
-    std::vector<uint8_t> packet;
-
-    // Add preambles
-    packet.push_back(0x59);
-    packet.push_back(0x35);
-
-    // Convert floats to bytes and add them to the packet
-    std::vector<uint8_t> bytesVal1 = util::floatToBytes(val1);
-    std::vector<uint8_t> bytesVal2 = util::floatToBytes(val2);
-    std::vector<uint8_t> bytesVal3 = util::floatToBytes(val3);
-
-    packet.insert(packet.end(), bytesVal1.begin(), bytesVal1.end());
-    packet.insert(packet.end(), bytesVal2.begin(), bytesVal2.end());
-    packet.insert(packet.end(), bytesVal3.begin(), bytesVal3.end());
+// Sends random packets of `Format` (values between 0 and 100) every 100 ms until the port fails.
+template <typename Format>
+int talk(boost::asio::serial_port& serial) {
+    // Initialize random seed
+    std::srand(0);
+    while (true) {
+        try {
+            util::Values<Format> values;
+            for (size_t i = 0; i < values.size(); ++i) {
+                values[i] = util::isInteger(Format::fields[i].type)
+                    ? std::rand() % 101
+                    : static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX / 100.0);  // Random between 0 and 100
+            }
+            // Send packet through serial port
+            boost::asio::write(serial, boost::asio::buffer(util::encode<Format>(values)));
 
-#ifdef CHECKSUM
-    // Calculate checksum (excluding the checksum byte itself)
-    uint8_t checksum = util::calculateChecksum(packet);
-    packet.push_back(checksum);
+#ifdef VERBOSE
+            std::cout << "Sent: ";
+            for (size_t i = 0; i < values.size(); ++i) {
+                std::cout << (i ? ", " : "") << values[i];
+            }
+            std::cout << std::endl;
 #endif
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        } catch (boost::system::system_error& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+}
 
-    // Send packet through serial port
-    boost::asio::write(serial, boost::asio::buffer(packet));
+struct Vendor {
+    const char* name;
+    int (*talk)(boost::asio::serial_port&);
+};
+
+template <typename... Formats>
+constexpr std::array<Vendor, sizeof...(Formats)> makeRegistry(util::FormatList<Formats...>) {
+    return {Vendor{Formats::name, &talk<Formats>}...};
 }
 
+constexpr auto vendors = makeRegistry(util::Vendors{});
+
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <COM port> <baud rate>" << std::endl;
+    std::string vendor = vendors[0].name;
+    if (argc == 5 && std::string(argv[3]) == "--vendor") {
+        vendor = argv[4];
+    }
+    auto selected = std::find_if(vendors.begin(), vendors.end(), [&vendor](const Vendor& v) { return vendor == v.name; });
+    if ((argc != 3 && argc != 5) || selected == vendors.end()) {
+        std::cerr << "Usage: " << argv[0] << " <COM port> <baud rate> [--vendor <name>]" << std::endl;
         return 1;
     }
 
     std::string port = argv[1];
     unsigned int baudRate = std::stoi(argv[2]);
-    boost::asio::io_service io;
+    boost::asio::io_context io;
     boost::asio::serial_port serial(io);
 
     try {
@@ -47,26 +72,6 @@ int main(int argc, char* argv[]) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
-    std::cout << "Sending data on port " << port << " at " << baudRate << " baud." << std::endl;
-
-    // Initialize random seed
-    std::srand(0);
-    while (true) {
-        try {
-            float val1 = static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX / 100.0);  // Random between 0 and 100
-            float val2 = static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX / 100.0);
-            float val3 = static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX / 100.0);
-            sendPacket(serial, val1, val2, val3);
-
-#ifdef VERBOSE
-            std::cout << "Sent: " << val1 << ", " << val2 << ", " << val3 << std::endl;
-#endif
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));  // Send every 1 second
-        } catch (boost::system::system_error& e) {
-            std::cerr << "Error: " << e.what() << std::endl;
-            return 1;
-        }
-    }
-
-    return 0;
+    std::cout << "Sending " << selected->name << " data on port " << port << " at " << baudRate << " baud." << std::endl;
+    return selected->talk(serial);
 }
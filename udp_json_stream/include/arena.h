@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+namespace util {
+
+/**
+ * @brief Monotonic memory arena: allocation bumps a pointer, nothing is freed until reset().
+ *
+ * Blocks are kept across resets, so once the arena has grown to the size of a typical batch of
+ * messages, decoding a batch does not touch the heap at all.
+ */
+class Arena {
+public:
+    explicit Arena(size_t block_size = 16 * 1024) : block_size_(block_size) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t alignment) {
+        while (true) {
+            if (current_ < blocks_.size()) {
+                Block& block = blocks_[current_];
+                size_t offset = (used_ + alignment - 1) & ~(alignment - 1);
+                if (offset + size <= block.size) {
+                    used_ = offset + size;
+                    ++allocations_;
+                    return block.data.get() + offset;
+                }
+                ++current_;
+                used_ = 0;
+                continue;
+            }
+            // grow: at least double the last block, and large enough for this request
+            size_t size_needed = std::max(size + alignment, blocks_.empty() ? block_size_ : blocks_.back().size * 2);
+            blocks_.push_back(Block{std::unique_ptr<char[]>(new char[size_needed]), size_needed});
+        }
+    }
+
+    // Copies `text` into the arena.
+    std::string_view copy(std::string_view text) {
+        if (text.empty()) {
+            return std::string_view();
+        }
+        char* memory = static_cast<char*>(allocate(text.size(), 1));
+        std::memcpy(memory, text.data(), text.size());
+        return std::string_view(memory, text.size());
+    }
+
+    // Forgets every allocation; the blocks are reused.
+    void reset() {
+        current_ = 0;
+        used_ = 0;
+        allocations_ = 0;
+    }
+
+    size_t allocations() const { return allocations_; }  // since the last reset
+    size_t capacity() const {
+        size_t total = 0;
+        for (const auto& block : blocks_) {
+            total += block.size;
+        }
+        return total;
+    }
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    size_t block_size_;
+    std::vector<Block> blocks_;
+    size_t current_ = 0;
+    size_t used_ = 0;
+    size_t allocations_ = 0;
+};
+
+namespace detail {
+inline Arena*& current_arena() {
+    thread_local Arena* arena = nullptr;
+    return arena;
+}
+}  // namespace detail
+
+/**
+ * @brief Makes `arena` the target of ArenaAllocator on this thread for the scope's lifetime.
+ *
+ * A null arena sends allocations back to the heap, for values that must outlive the current arena.
+ */
+class ArenaScope {
+public:
+    explicit ArenaScope(Arena* arena) : previous_(detail::current_arena()) { detail::current_arena() = arena; }
+    ~ArenaScope() { detail::current_arena() = previous_; }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+    Arena* previous_;
+};
+
+/**
+ * @brief Stateless allocator serving from the thread's current arena (see ArenaScope), else the heap.
+ *
+ * basic_json creates its allocators on the fly, so the arena cannot be passed in and is taken from
+ * a thread-local instead. Each allocation is prefixed with the arena it came from: values built
+ * inside a scope may be destroyed anywhere (e.g. on a writer thread) as long as their arena has not
+ * been reset, and values built outside any scope are ordinary heap allocations.
+ */
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    using is_always_equal = std::true_type;
+
+    ArenaAllocator() = default;
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        static_assert(alignof(T) <= header_size, "over-aligned types are not supported");
+        const size_t size = header_size + n * sizeof(T);
+        Arena* arena = detail::current_arena();
+        char* memory = arena ? static_cast<char*>(arena->allocate(size, header_size))
+                             : static_cast<char*>(::operator new(size));
+        *reinterpret_cast<Arena**>(memory) = arena;
+        return reinterpret_cast<T*>(memory + header_size);
+    }
+
+    void deallocate(T* p, size_t) {
+        char* memory = reinterpret_cast<char*>(p) - header_size;
+        if (*reinterpret_cast<Arena**>(memory) == nullptr) {
+            ::operator delete(memory);
+        }
+        // arena memory is released all at once by Arena::reset()
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>&) const { return false; }
+
+private:
+    static constexpr size_t header_size = alignof(std::max_align_t);
+};
+
+// nlohmann::json whose objects, arrays and strings are allocated with ArenaAllocator.
+// Strings keep std::allocator for their characters, which short keys and values keep inline.
+using arena_json = nlohmann::basic_json<std::map, std::vector, std::string, bool, std::int64_t, std::uint64_t, double, ArenaAllocator>;
+
+}  // namespace util
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+/**
+ * @brief Byte queue over a power-of-two ring, for cutting a stream into messages.
+ *
+ * Bytes are received straight into the free space (write_span, commit) and taken from the front
+ * (find, contiguous, consume) without moving the rest. Either side may wrap around the end of the
+ * storage; only a message that wraps is copied to be handed out in one piece. The ring starts
+ * small and doubles when full, up to `max_capacity`, so idle connections stay cheap.
+ */
+class ByteRing {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    ByteRing(size_t initial_capacity, size_t max_capacity)
+        : capacity_(round_up(initial_capacity)), max_capacity_(std::max(round_up(max_capacity), capacity_)),
+          data_(new char[capacity_]) {}
+
+    size_t size() const { return static_cast<size_t>(write_ - read_); }
+    size_t capacity() const { return capacity_; }
+    bool full() const { return size() == capacity_; }
+
+    // Contiguous free space to receive into, empty only when full at the largest capacity.
+    std::pair<char*, size_t> write_span() {
+        if (full() && capacity_ < max_capacity_) {
+            grow();
+        }
+        size_t start = static_cast<size_t>(write_) & (capacity_ - 1);
+        size_t free = capacity_ - size();
+        return {data_.get() + start, std::min(free, capacity_ - start)};
+    }
+
+    void commit(size_t count) { write_ += count; }
+    void consume(size_t count) { read_ += count; }
+    void clear() { read_ = write_; }
+
+    // Byte at `offset` from the front.
+    char at(size_t offset) const { return data_[(read_ + offset) & (capacity_ - 1)]; }
+
+    // Offset of the first `c` at or after `from`, or npos.
+    size_t find(char c, size_t from) const {
+        while (from < size()) {
+            size_t start = (read_ + from) & (capacity_ - 1);
+            size_t length = std::min(size() - from, capacity_ - start);
+            if (const void* hit = std::memchr(data_.get() + start, c, length)) {
+                return from + static_cast<size_t>(static_cast<const char*>(hit) - (data_.get() + start));
+            }
+            from += length;
+        }
+        return npos;
+    }
+
+    // The `length` bytes at `offset`: in place, or copied to `scratch` if they wrap around.
+    // Valid until the next write_span() or call with the same scratch.
+    const char* contiguous(size_t offset, size_t length, std::vector<char>& scratch) const {
+        size_t start = (read_ + offset) & (capacity_ - 1);
+        if (start + length <= capacity_) {
+            return data_.get() + start;
+        }
+        size_t first = capacity_ - start;
+        scratch.resize(length);
+        std::memcpy(scratch.data(), data_.get() + start, first);
+        std::memcpy(scratch.data() + first, data_.get(), length - first);
+        return scratch.data();
+    }
+
+private:
+    static size_t round_up(size_t n) {
+        size_t capacity = 1;
+        while (capacity < n) {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    void grow() {
+        std::unique_ptr<char[]> data(new char[capacity_ * 2]);
+        size_t count = size();
+        size_t start = static_cast<size_t>(read_) & (capacity_ - 1);
+        size_t first = std::min(count, capacity_ - start);
+        std::memcpy(data.get(), data_.get() + start, first);
+        std::memcpy(data.get() + first, data_.get(), count - first);
+        data_ = std::move(data);
+        capacity_ *= 2;
+        read_ = 0;
+        write_ = count;
+    }
+
+    size_t capacity_;
+    size_t max_capacity_;
+    std::unique_ptr<char[]> data_;
+    uint64_t read_ = 0;   // total bytes consumed
+    uint64_t write_ = 0;  // total bytes committed
+};
+
+}  // namespace util
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+#include "key_table.h"
+
+namespace util {
+
+// Appends `str` to `out` as a quoted csv field, doubling quotes.
+inline void append_csv_escaped(std::string& out, std::string_view str) {
+    out += '"';
+    // memchr is vectorized by the C library; most values have no quote at all
+    while (const void* quote = std::memchr(str.data(), '"', str.size())) {
+        size_t length = static_cast<const char*>(quote) - str.data() + 1;
+        out.append(str.data(), length);
+        out += '"';
+        str.remove_prefix(length);
+    }
+    out.append(str.data(), str.size());
+    out += '"';
+}
+
+inline std::string escape_csv(std::string_view str) {
+    std::string out;
+    append_csv_escaped(out, str);
+    return out;
+}
+
+// Appends one cell as it would be written by nlohmann's serializer (numbers, booleans) or quoted (strings).
+inline void append_csv_cell(std::string& out, const Cell& value) {
+    char buffer[64];
+    char* end = buffer;
+    switch (value.type) {
+        case Cell::Type::string: append_csv_escaped(out, value.text); return;
+        case Cell::Type::boolean: out += value.boolean ? "true" : "false"; return;
+        case Cell::Type::integer: end = std::to_chars(buffer, buffer + sizeof(buffer), value.integer).ptr; break;
+        case Cell::Type::unsigned_integer: end = std::to_chars(buffer, buffer + sizeof(buffer), value.unsigned_integer).ptr; break;
+        case Cell::Type::floating:
+            if (!std::isfinite(value.floating)) {
+                out += "null";
+                return;
+            }
+            // nlohmann's own shortest round-trip formatting (with ".0" on integral values), not std::to_chars'
+            end = nlohmann::detail::to_chars(buffer, buffer + sizeof(buffer), value.floating);
+            break;
+        default: return;
+    }
+    out.append(buffer, end);
+}
+
+// Appends a csv line of the `columns` of `row`; missing values are empty fields.
+inline void append_csv_line(std::string& out, const std::vector<Cell>& row, const std::vector<size_t>& columns) {
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (i > 0) {
+            out += ',';
+        }
+        if (columns[i] < row.size()) {
+            append_csv_cell(out, row[columns[i]]);
+        }
+    }
+    out += '\n';
+}
+
+/**
+ * @brief CSV writer that follows the key set of a feed as it grows.
+ *
+ * The header of a segment is fixed when the segment starts. When a message introduces a key the
+ * KeyTable has not seen before, a new segment ("<name>_v<N>.csv") is started whose columns are the
+ * previous ones followed by the new ones, and the mapping is appended to "<name>.schema.jsonl".
+ * The KeyTable only grows, so its size is the fingerprint of the key set: the per-message check is
+ * a single comparison.
+ *
+ * Lines are formatted into one buffer that is handed to the file when it is full and on flush().
+ */
+class SchemaCsvWriter {
+public:
+    explicit SchemaCsvWriter(const std::string& csv_filename)
+        : path_(csv_filename), file_(csv_filename) {
+        buffer_.reserve(buffer_size);
+    }
+
+    ~SchemaCsvWriter() { write_buffer(); }
+
+    SchemaCsvWriter(const SchemaCsvWriter&) = delete;
+    SchemaCsvWriter& operator=(const SchemaCsvWriter&) = delete;
+
+    bool is_open() const { return file_.is_open(); }
+    size_t version() const { return version_; }
+    std::string path() const { return path_.string(); }  // of the first segment
+    const std::string& filename() const { return filename_; }  // of the current segment
+    size_t columns() const { return columns_.size(); }
+
+    void write(const KeyTable& keys, const std::vector<Cell>& row) {
+        if (keys.size() != known_) {
+            start_segment(keys);
+        }
+        append_csv_line(buffer_, row, columns_);
+        ++rows_;
+        if (buffer_.size() >= buffer_size) {
+            write_buffer();
+        }
+    }
+
+    void flush() {
+        write_buffer();
+        file_.flush();
+    }
+
+    // Writes what is buffered and closes the segment and the sidecar.
+    void close() {
+        write_buffer();
+        file_.close();
+        sidecar_.close();
+    }
+
+private:
+    static constexpr size_t buffer_size = 64 * 1024;
+
+    void write_buffer() {
+        file_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        buffer_.clear();
+    }
+
+    void start_segment(const KeyTable& keys) {
+        // the lines so far belong to the previous segment
+        write_buffer();
+        std::vector<size_t> added = keys.sorted_columns(known_, keys.size());
+        columns_.insert(columns_.end(), added.begin(), added.end());
+        known_ = keys.size();
+        ++version_;
+
+        std::filesystem::path segment = path_;
+        if (version_ > 1) {
+            file_.close();
+            segment.replace_filename(path_.stem().string() + "_v" + std::to_string(version_) + path_.extension().string());
+            file_.open(segment);
+            if (!file_.is_open()) {
+                std::cerr << "Failed to open " << segment.string() << "\n";
+            }
+        }
+        filename_ = segment.string();
+
+        nlohmann::json names = nlohmann::json::array();
+        for (size_t i = 0; i < columns_.size(); i++) {
+            names.push_back(keys.name(columns_[i]));
+            if (i > 0) {
+                buffer_ += ',';
+            }
+            append_csv_escaped(buffer_, keys.name(columns_[i]));
+        }
+        buffer_ += '\n';
+
+        if (!sidecar_.is_open()) {
+            std::filesystem::path sidecar = path_;
+            sidecar.replace_extension(".schema.jsonl");
+            sidecar_.open(sidecar);
+        }
+        sidecar_ << nlohmann::json{
+            {"version", version_},
+            {"file", segment.filename().string()},
+            {"first_row", rows_},
+            {"columns", names}
+        }.dump() << std::endl;
+    }
+
+    std::filesystem::path path_;
+    std::ofstream file_;
+    std::ofstream sidecar_;
+    std::string buffer_;  // lines not yet handed to file_
+    std::string filename_;
+    std::vector<size_t> columns_;
+    size_t known_ = 0;
+    size_t version_ = 0;
+    size_t rows_ = 0;
+};
+
+}  // namespace util
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "socket.h"
+#ifndef _WIN32
+    #include <sys/epoll.h>
+#endif
+
+#include "receiver.h"
+#include "udp_listener.h"
+
+namespace util {
+
+/**
+ * @brief One thread receiving for many feeds: UDP ports, multicast groups and TCP connections.
+ *
+ * Ready sockets are found with epoll on Linux and select() elsewhere, and handed to the handler
+ * they were watched with. All UdpListeners share one BufferPool and one DatagramReceiver, so
+ * receive memory is batch * buffer_size in total however many feeds there are. Each ready socket
+ * gets one batch per wakeup, so a busy feed cannot starve the others. Periodic tasks (e.g. a status
+ * display) run on the same thread, between batches.
+ */
+class EventLoop {
+public:
+    using Handler = std::function<void()>;
+
+    EventLoop(size_t batch, size_t buffer_size)
+        : pool_(batch, buffer_size), receiver_(pool_, batch) {
+#ifndef _WIN32
+        epoll_ = epoll_create1(0);
+        if (epoll_ < 0) {
+            std::cerr << "Failed to create epoll instance\n";
+        }
+#endif
+    }
+
+    ~EventLoop() {
+#ifndef _WIN32
+        if (epoll_ >= 0) {
+            close(epoll_);
+        }
+#endif
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // `listener` must be bound and outlive the loop.
+    bool add(UdpListener& listener) {
+        return watch(listener.socket(), listener.name(), [this, &listener]() { receive(listener); });
+    }
+
+    // Calls `on_readable` on the loop thread whenever `sock` has data (or a connection) waiting.
+    bool watch(SocketType sock, const std::string& name, Handler on_readable) {
+#ifdef _WIN32
+        if (watches_.size() >= FD_SETSIZE) {
+            std::cerr << "Too many sockets for select(), not watching " << name << "\n";
+            return false;
+        }
+#else
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = sock;
+        if (epoll_ctl(epoll_, EPOLL_CTL_ADD, sock, &event) < 0) {
+            std::cerr << "Failed to watch " << name << "\n";
+            return false;
+        }
+#endif
+        watches_[sock] = std::make_shared<Watch>(Watch{std::move(on_readable), false});
+        return true;
+    }
+
+    // Stops watching `sock`; call before closing it. Safe from within its own handler.
+    void unwatch(SocketType sock) {
+#ifndef _WIN32
+        epoll_ctl(epoll_, EPOLL_CTL_DEL, sock, nullptr);
+#endif
+        watches_.erase(sock);
+    }
+
+    // Leaves `sock` unread while paused, e.g. to let TCP flow control hold back its sender.
+    void pause(SocketType sock, bool paused) {
+        auto it = watches_.find(sock);
+        if (it == watches_.end() || it->second->paused == paused) {
+            return;
+        }
+        it->second->paused = paused;
+#ifndef _WIN32
+        epoll_event event{};
+        event.events = paused ? 0u : static_cast<uint32_t>(EPOLLIN);
+        event.data.fd = sock;
+        epoll_ctl(epoll_, EPOLL_CTL_MOD, sock, &event);
+#endif
+    }
+
+    // Runs `task` on the loop thread about every `period`, from the next run() on.
+    void every(std::chrono::milliseconds period, std::function<void()> task) {
+        timers_.push_back(Timer{period, std::chrono::steady_clock::now() + period, std::move(task)});
+    }
+
+    // Receives and dispatches until `running` is cleared.
+    void run(const std::atomic<bool>& running) {
+        std::vector<SocketType> ready;
+#ifndef _WIN32
+        std::vector<epoll_event> events(64);
+#endif
+        while (running) {
+            ready.clear();
+            // wake up regularly so that the loop notices when it should stop, and for the timers
+            auto timeout = std::chrono::milliseconds(100);
+            auto now = std::chrono::steady_clock::now();
+            for (const Timer& timer : timers_) {
+                timeout = std::min(timeout, std::max(std::chrono::duration_cast<std::chrono::milliseconds>(timer.next - now), std::chrono::milliseconds(0)));
+            }
+#ifdef _WIN32
+            fd_set readable;
+            FD_ZERO(&readable);
+            for (const auto& entry : watches_) {
+                if (!entry.second->paused) {
+                    FD_SET(entry.first, &readable);
+                }
+            }
+            timeval wait{0, static_cast<long>(timeout.count() * 1000)};
+            int count = readable.fd_count ? select(0, &readable, nullptr, nullptr, &wait) : (Sleep(static_cast<DWORD>(timeout.count())), 0);
+            for (u_int i = 0; count > 0 && i < readable.fd_count; ++i) {
+                ready.push_back(readable.fd_array[i]);
+            }
+#else
+            int count = epoll_wait(epoll_, events.data(), static_cast<int>(events.size()), static_cast<int>(timeout.count()));
+            for (int i = 0; i < count; ++i) {
+                ready.push_back(events[i].data.fd);
+            }
+#endif
+            for (SocketType sock : ready) {
+                // an earlier handler may have unwatched it; the handler may unwatch itself
+                auto it = watches_.find(sock);
+                if (it != watches_.end() && !it->second->paused) {
+                    std::shared_ptr<Watch> watch = it->second;
+                    watch->handler();
+                }
+            }
+            if (!timers_.empty()) {
+                now = std::chrono::steady_clock::now();
+                for (Timer& timer : timers_) {
+                    if (now >= timer.next) {
+                        timer.task();
+                        timer.next = now + timer.period;
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    struct Watch {
+        Handler handler;
+        bool paused;
+    };
+
+    struct Timer {
+        std::chrono::milliseconds period;
+        std::chrono::steady_clock::time_point next;
+        std::function<void()> task;
+    };
+
+    void receive(UdpListener& listener) {
+        int count = receiver_.receive(listener.socket(), false);
+        if (count == SOCKET_ERROR_CODE) {
+            std::cerr << "Failed to receive on " << listener.name() << "\n";
+            return;
+        }
+
+        auto arrival_time = std::chrono::steady_clock::now();
+        int64_t arrival_epoch_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        listener.process(receiver_, count, arrival_time, arrival_epoch_us);
+    }
+
+    BufferPool pool_;
+    DatagramReceiver receiver_;
+    std::unordered_map<SocketType, std::shared_ptr<Watch>> watches_;
+    std::vector<Timer> timers_;
+#ifndef _WIN32
+    int epoll_ = -1;
+#endif
+};
+
+}  // namespace util
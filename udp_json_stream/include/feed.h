@@ -0,0 +1,458 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+#include "socket.h"
+#include "key_table.h"
+#include "csv_writer.h"
+#include "receiver.h"
+#include "payload.h"
+#include "histogram.h"
+#include "sequence_tracker.h"
+#include "projection.h"
+#include "writer_pool.h"
+#include "arena.h"
+#include "json_reader.h"
+
+namespace util {
+
+struct ListenerOptions {
+    bool expand_arrays = true;                                    // numeric arrays -> one column per element
+    std::vector<std::pair<std::string, std::vector<std::string>>> array_names;  // e.g. location -> x,y,z
+    bool merge_sources = false;                                   // one csv with a SourceAddress column
+    size_t buffer_size = 65536;                                   // receive buffer per datagram
+    size_t batch = 16;                                            // datagrams per recvmmsg
+    bool verbose = false;                                         // print new senders and schema changes
+    size_t dump_every = 0;                                        // print every n-th message in full, 0 for none
+    bool keep_latest = false;                                     // keep a copy of a recent payload, see latest()
+    bool record_latency = false;                                  // arrival-to-flushed latency histogram
+    std::string seq_field;                                        // sequence number, for loss and reordering
+    std::string time_field;                                       // send time since epoch, for one-way latency
+    int64_t time_unit_us = 1000;                                  // microseconds per time_field unit (ms)
+    std::vector<std::string> projection;                          // json pointers to keep, empty for everything
+};
+
+/**
+ * @brief Csv output of one feed: its own key table, row and schema segments.
+ */
+struct Stream {
+    Stream(const std::string& csv_filename, const ListenerOptions& options, bool tag_source)
+        : csv_file(csv_filename) {
+        for (const auto& names : options.array_names) {
+            keys.set_element_names(names.first, names.second);
+        }
+        arrival_column = keys.column("ArrivalTimeUs");
+        if (tag_source) {
+            source_column = keys.column("SourceAddress");
+        }
+        row.resize(keys.size());
+    }
+
+    KeyTable keys;
+    std::vector<Cell> row;
+    Arena scratch;  // decoded messages and unescaped strings of the row being written
+    SchemaCsvWriter csv_file;
+    size_t arrival_column = 0;
+    size_t source_column = SIZE_MAX;
+    // columns of the tracked fields, looked up again only when the key table grows
+    size_t seq_column = KeyTable::npos;
+    size_t time_column = KeyTable::npos;
+    size_t tracked_keys = 0;
+    bool dirty = false;  // written since the last flush
+};
+
+/**
+ * @brief State of one sender, looked up by its address without formatting it.
+ */
+struct Source {
+    std::string address;  // "ip:port", formatted once when the sender is first seen
+    std::shared_ptr<Stream> stream;
+    uint64_t messages = 0;
+    SequenceTracker tracker;
+};
+
+// One line per sender: messages and, when tracked, loss, reordering and latency.
+inline void print_tracker(const Source& source) {
+    const SequenceTracker& tracker = source.tracker;
+    std::cout << source.address << ": " << source.messages << " messages";
+    if (tracker.received()) {
+        std::cout << ", lost " << tracker.lost() << " (" << tracker.loss_percent() << "%)"
+                  << ", reordered " << tracker.reordered() << " (max depth " << tracker.reorder_depth().max() << ")"
+                  << ", duplicates " << tracker.duplicates() << ", restarts " << tracker.restarts();
+    }
+    const Histogram& latency = tracker.latency();
+    if (latency.count()) {
+        std::cout << ", latency us p50 " << latency.percentile(50) << " p99 " << latency.percentile(99) << " max " << latency.max();
+    }
+    if (tracker.negative_latency()) {
+        std::cout << ", " << tracker.negative_latency() << " sent after arrival (clock offset?)";
+    }
+    std::cout << std::endl;
+}
+
+// Packs an IPv4 address and port into a hash key.
+inline uint64_t source_key(const sockaddr_in& addr) {
+    return (static_cast<uint64_t>(ntohl(addr.sin_addr.s_addr)) << 16) | ntohs(addr.sin_port);
+}
+
+/**
+ * @brief Logs the json/cbor/msgpack messages of one feed to csv, per sender.
+ *
+ * The receiving side (UdpListener, TcpListener) hands over batches of messages with process(). With
+ * a WriterPool, payloads are copied into one Arena per batch, reused once its messages are written,
+ * and decoded, flattened and written on the pool. Json payloads are flattened in place
+ * (JsonRowReader), without building a json value; cbor, msgpack and projected payloads are decoded
+ * into the Stream's scratch arena.
+ */
+class Feed {
+public:
+    Feed(const ListenerOptions& options, const std::string& csv_filename)
+        : options_(options), csv_filename_(csv_filename), projection_(options.projection) {
+        // tracked fields have to be decoded even if they were not asked for
+        if (!projection_.empty()) {
+            for (const auto& field : {options.seq_field, options.time_field}) {
+                if (!field.empty()) {
+                    std::string pointer = "/" + field;
+                    std::replace(pointer.begin(), pointer.end(), '.', '/');
+                    projection_.add(pointer);
+                }
+            }
+        }
+    }
+
+    virtual ~Feed() = default;
+
+    Feed(const Feed&) = delete;
+    Feed& operator=(const Feed&) = delete;
+
+    // Flatten and write on `writers` instead of the receiving thread; call before receiving.
+    void set_writers(WriterPool& writers) {
+        writers_ = &writers;
+        worker_ = writers.assign();
+        writers.on_flush(worker_, [this]() { flush(); });
+    }
+
+
+    ReceiveStats stats() const {
+        ReceiveStats stats = stats_;
+        stats.malformed += invalid_.load(std::memory_order_relaxed);
+        return stats;
+    }
+    const Histogram& latency() const { return latency_; }
+    const std::unordered_map<uint64_t, Source>& sources() const { return sources_; }
+    const std::string& name() const { return name_; }
+    // The first complete payload received after the last sample_latest(), when `keep_latest` is set.
+    const std::string& latest() const { return latest_; }
+    Encoding latest_encoding() const { return latest_encoding_; }
+    // Keeps the next payload as latest(); sampled once per call rather than copied for every message.
+    void sample_latest() { latest_wanted_ = true; }
+
+    // Messages handed to the writers and not written yet, for a receiver that wants to hold back.
+    using Pending = std::shared_ptr<std::atomic<int64_t>>;
+
+    // Processes the first `count` messages of `batch` (anything indexed to a Datagram, e.g. a
+    // DatagramReceiver); with writers, their payloads share one arena and are counted in `pending`.
+    template <typename Batch>
+    void process(const Batch& batch, int count, std::chrono::steady_clock::time_point arrival_time, int64_t arrival_epoch_us, const Pending& pending = nullptr) {
+        if (count <= 0) {
+            return;
+        }
+        std::shared_ptr<Arena> arena = writers_ ? next_arena() : nullptr;
+        for (int i = 0; i < count; ++i) {
+            process(batch[i], arena, arrival_time, arrival_epoch_us, pending);
+        }
+    }
+
+private:
+    void process(const Datagram& datagram, const std::shared_ptr<Arena>& arena, std::chrono::steady_clock::time_point arrival_time, int64_t arrival_epoch_us, const Pending& pending) {
+        ++stats_.datagrams;
+        stats_.bytes += datagram.size;
+        if (datagram.truncated) {
+            ++stats_.truncated;
+            std::cerr << "Truncated message (" << datagram.size << " bytes kept, " << stats_.truncated << " so far)\n";
+            return;
+        }
+
+        Encoding encoding = detect_encoding(datagram.data, datagram.size);
+        if (encoding == Encoding::unknown) {
+            ++stats_.malformed;
+            std::cerr << "Unknown payload encoding\n";
+            return;
+        }
+
+        if (options_.keep_latest && latest_wanted_) {
+            latest_.assign(datagram.data, datagram.size);
+            latest_encoding_ = encoding;
+            latest_wanted_ = false;
+        }
+
+        Source& source = find_source(datagram.from);
+        if (options_.dump_every && stats_.datagrams % options_.dump_every == 0) {
+            dump(source, datagram, encoding);
+        }
+        if (writers_) {
+            // the receive buffer is reused by the next batch; the task keeps the arena until the message is written
+            char* payload = static_cast<char*>(arena->allocate(datagram.size, 1));
+            std::memcpy(payload, datagram.data, datagram.size);
+            if (pending) {
+                pending->fetch_add(1, std::memory_order_relaxed);
+            }
+            auto task = [this, &source, arena, payload, size = datagram.size, encoding, arrival_time, arrival_epoch_us, pending]() {
+                write(source, payload, size, encoding, arrival_time, arrival_epoch_us);
+                if (pending) {
+                    pending->fetch_sub(1, std::memory_order_relaxed);
+                }
+            };
+            bool posted = true;
+            if (reliable_) {
+                writers_->push(worker_, std::move(task));
+            } else {
+                posted = writers_->post(worker_, std::move(task));
+            }
+            if (!posted && pending) {
+                pending->fetch_sub(1, std::memory_order_relaxed);
+            }
+        } else {
+            write(source, datagram.data, datagram.size, encoding, arrival_time, arrival_epoch_us);
+            flush();
+        }
+    }
+
+    // Prints a message in full; decoded separately, it is rare enough.
+    void dump(const Source& source, const Datagram& datagram, Encoding encoding) const {
+        try {
+            nlohmann::json message = projection_.empty()
+                ? decode_payload(datagram.data, datagram.size, encoding)
+                : decode_projected<nlohmann::json>(datagram.data, datagram.size, encoding, projection_);
+            std::cout << "Received " << encoding_name(encoding) << " message #" << stats_.datagrams << " from "
+                      << source.address << ":\n" << message.dump(2) << "\n";
+        }
+        catch (nlohmann::json::exception&) {
+            // counted as malformed when it is written
+        }
+    }
+
+    // An arena no queued message refers to any more. Arenas are handed out round robin, so the one
+    // at the cursor is the oldest; if it is still in use, a new one is inserted before it.
+    std::shared_ptr<Arena> next_arena() {
+        if (!arenas_.empty() && arenas_[arena_cursor_].use_count() == 1) {
+            // pairs with the release of the writer's reference
+            std::atomic_thread_fence(std::memory_order_acquire);
+            std::shared_ptr<Arena>& arena = arenas_[arena_cursor_];
+            arena_cursor_ = (arena_cursor_ + 1) % arenas_.size();
+            arena->reset();
+            return arena;
+        }
+        auto arena = std::make_shared<Arena>();
+        arenas_.insert(arenas_.begin() + arena_cursor_, arena);
+        arena_cursor_ = (arena_cursor_ + 1) % arenas_.size();
+        return arena;
+    }
+
+    // Decodes, flattens and writes one message; runs on the writer thread when there is one.
+    void write(Source& source, const char* data, size_t size, Encoding encoding, std::chrono::steady_clock::time_point arrival_time, int64_t arrival_epoch_us) {
+        Stream& stream = *source.stream;
+        stream.scratch.reset();
+        ArenaScope scope(&stream.scratch);
+        std::fill(stream.row.begin(), stream.row.end(), Cell());
+        KeyTable::Mark mark = stream.keys.mark();
+        arena_json message;  // the cells refer to it until the row is written
+        try {
+            bool read = false;
+            if (encoding == Encoding::json && projection_.empty()) {
+                read = reader_.read(data, size, stream.keys, stream.row, stream.scratch, options_.expand_arrays);
+                if (!read) {
+                    // a repeated key: nlohmann keeps the last value and only its columns
+                    stream.keys.rollback(mark);
+                    std::fill(stream.row.begin(), stream.row.end(), Cell());
+                }
+            }
+            if (!read) {
+                message = projection_.empty()
+                    ? decode_payload<arena_json>(data, size, encoding)
+                    : decode_projected<arena_json>(data, size, encoding, projection_);
+                flatten_json(message, stream.keys, KeyTable::root, stream.row, stream.scratch, options_.expand_arrays);
+            }
+        }
+        catch (nlohmann::json::exception&) {
+            // keys of a message that is not written would add empty columns
+            stream.keys.rollback(mark);
+            invalid_.fetch_add(1, std::memory_order_relaxed);
+            std::cerr << "Invalid " << encoding_name(encoding) << " message\n";
+            return;
+        }
+        // manual time tag
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(arrival_time.time_since_epoch()).count();
+        stream.row[stream.arrival_column] = Cell::of(static_cast<int64_t>(micros));
+        if (stream.source_column != SIZE_MAX) {
+            stream.row[stream.source_column] = Cell::string(source.address);
+        }
+        ++source.messages;
+        if (!options_.seq_field.empty() || !options_.time_field.empty()) {
+            track(source, stream, arrival_epoch_us);
+        }
+
+        auto& csv_file = stream.csv_file;
+        size_t version = csv_file.version();
+        csv_file.write(stream.keys, stream.row);
+        if (options_.verbose && csv_file.version() != version) {
+            std::cout << "Schema v" << csv_file.version() << ": " << csv_file.columns() << " columns -> " << csv_file.filename() << std::endl;
+        }
+        if (!stream.dirty) {
+            stream.dirty = true;
+            dirty_.push_back(&stream);
+        }
+
+        if (options_.record_latency) {
+            unflushed_.push_back(arrival_time);
+        }
+    }
+
+    // Hands the written lines to the files; a message's latency ends here, not when it is formatted.
+    void flush() {
+        for (Stream* stream : dirty_) {
+            stream->csv_file.flush();
+            stream->dirty = false;
+        }
+        dirty_.clear();
+        if (!unflushed_.empty()) {
+            auto now = std::chrono::steady_clock::now();
+            for (auto arrival_time : unflushed_) {
+                latency_.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - arrival_time).count()));
+            }
+            unflushed_.clear();
+        }
+    }
+
+    void track(Source& source, Stream& stream, int64_t arrival_epoch_us) {
+        if (stream.tracked_keys != stream.keys.size()) {
+            stream.seq_column = options_.seq_field.empty() ? KeyTable::npos : stream.keys.find(options_.seq_field);
+            stream.time_column = options_.time_field.empty() ? KeyTable::npos : stream.keys.find(options_.time_field);
+            stream.tracked_keys = stream.keys.size();
+        }
+        if (stream.seq_column != KeyTable::npos) {
+            const Cell& seq = stream.row[stream.seq_column];
+            if (seq.is_integer()) {
+                source.tracker.track_sequence(seq.type == Cell::Type::integer ? static_cast<uint64_t>(seq.integer) : seq.unsigned_integer);
+            }
+        }
+        if (stream.time_column != KeyTable::npos) {
+            const Cell& sent = stream.row[stream.time_column];
+            if (sent.is_number()) {
+                int64_t sent_us = sent.is_integer()
+                    ? (sent.type == Cell::Type::integer ? sent.integer : static_cast<int64_t>(sent.unsigned_integer)) * options_.time_unit_us
+                    : static_cast<int64_t>(sent.floating * options_.time_unit_us);
+                source.tracker.track_latency(arrival_epoch_us - sent_us);
+            }
+        }
+    }
+
+protected:
+    // The writers are behind: a reliable receiver should stop reading.
+    bool writers_busy() const { return writers_ && writers_->busy(worker_); }
+
+    // Forgets a sender that is gone (a TCP connection) and closes its files, once the writers are
+    // done with its messages; its tracker line is printed first, as it would have been on exit.
+    void retire_source(const sockaddr_in& addr) {
+        auto it = sources_.find(source_key(addr));
+        if (it == sources_.end()) {
+            return;  // sent nothing
+        }
+        // the node keeps the Source where queued tasks refer to it
+        auto node = std::make_shared<decltype(sources_)::node_type>(sources_.extract(it));
+        auto retire = [this, node]() {
+            Source& source = node->mapped();
+            if (!options_.seq_field.empty() || !options_.time_field.empty()) {
+                print_tracker(source);
+            }
+            if (!options_.merge_sources) {
+                Stream& stream = *source.stream;
+                if (stream.dirty) {
+                    dirty_.erase(std::find(dirty_.begin(), dirty_.end(), &stream));
+                    stream.dirty = false;
+                }
+                stream.csv_file.close();
+            }
+        };
+        if (writers_) {
+            writers_->push(worker_, std::move(retire));
+        } else {
+            retire();
+        }
+    }
+
+private:
+    Source& find_source(const sockaddr_in& addr) {
+        auto it = sources_.find(source_key(addr));
+        if (it != sources_.end()) {
+            return it->second;
+        }
+
+        char client_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr.sin_addr, client_ip, INET_ADDRSTRLEN);
+        Source source;
+        source.address = std::string(client_ip) + ":" + std::to_string(ntohs(addr.sin_port));
+
+        if (options_.merge_sources) {
+            if (!merged_) {
+                merged_ = std::make_shared<Stream>(csv_filename_, options_, true);
+            }
+            source.stream = merged_;
+        } else {
+            // one file per sender: <time>_<ip>-<port>.csv, then _2, _3... for a sender that reconnects
+            // from the same port after its connection was retired, instead of truncating its file
+            std::filesystem::path path = csv_filename_;
+            std::string name = path.stem().string() + "_" + client_ip + "-" + std::to_string(ntohs(addr.sin_port));
+            unsigned opened = ++opened_[source_key(addr)];
+            if (opened > 1) {
+                name += "_" + std::to_string(opened);
+            }
+            path.replace_filename(name + path.extension().string());
+            source.stream = std::make_shared<Stream>(path.string(), options_, false);
+        }
+        if (!source.stream->csv_file.is_open()) {
+            std::cerr << "Failed to open csv file for " << source.address << "\n";
+        }
+        if (options_.verbose) {
+            std::cout << "New source " << source.address << " -> " << source.stream->csv_file.path() << "\n";
+        }
+        return sources_.emplace(source_key(addr), std::move(source)).first->second;
+    }
+
+protected:
+    ListenerOptions options_;
+    std::string name_;
+    bool reliable_ = false;  // messages are never dropped by the writers; the receiver holds back instead
+
+private:
+    std::string csv_filename_;
+    Projection projection_;
+    WriterPool* writers_ = nullptr;
+    size_t worker_ = 0;
+    std::vector<Stream*> dirty_;  // streams written since the last flush, writer side only
+    std::vector<std::chrono::steady_clock::time_point> unflushed_;  // arrival of the messages in them, with record_latency
+    std::vector<std::shared_ptr<Arena>> arenas_;
+    size_t arena_cursor_ = 0;
+    std::unordered_map<uint64_t, Source> sources_;
+    std::unordered_map<uint64_t, unsigned> opened_;  // files opened per sender, for the names of later ones
+    std::shared_ptr<Stream> merged_;
+    ReceiveStats stats_;
+    std::atomic<uint64_t> invalid_{0};  // payloads that failed to decode, counted by the writer
+    JsonRowReader reader_;  // writer side
+    Histogram latency_;
+    std::string latest_;
+    Encoding latest_encoding_ = Encoding::unknown;
+    bool latest_wanted_ = true;
+};
+
+}  // namespace util
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+namespace util {
+
+/**
+ * @brief Fixed-size log-linear histogram of unsigned values (e.g. latencies in microseconds).
+ *
+ * Values below 32 are counted exactly; above that every power of two is split into 16 buckets,
+ * i.e. a relative error below 6.25%. Recording is a few integer operations and never allocates.
+ */
+class Histogram {
+public:
+    static constexpr int sub_bits = 4;
+    static constexpr uint64_t sub_count = 1 << sub_bits;
+    static constexpr size_t bucket_count = (65 - sub_bits) * sub_count;
+
+    void record(uint64_t value) {
+        ++buckets_[index(value)];
+        ++count_;
+        sum_ += value;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    void merge(const Histogram& other) {
+        for (size_t i = 0; i < bucket_count; ++i) {
+            buckets_[i] += other.buckets_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    void reset() { *this = Histogram(); }
+
+    uint64_t count() const { return count_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0.0; }
+
+    // Upper bound of the bucket holding the `p`-th percentile (0 < p <= 100), clamped to the maximum.
+    uint64_t percentile(double p) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        auto rank = static_cast<uint64_t>(p / 100.0 * count_ + 0.5);
+        rank = std::max<uint64_t>(rank, 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; ++i) {
+            seen += buckets_[i];
+            if (seen >= rank) {
+                return std::min(upper_bound(i), max_);
+            }
+        }
+        return max_;
+    }
+
+private:
+    static int most_significant_bit(uint64_t value) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return static_cast<int>(index);
+#else
+        return 63 - __builtin_clzll(value);
+#endif
+    }
+
+    static size_t index(uint64_t value) {
+        if (value < 2 * sub_count) {
+            return static_cast<size_t>(value);
+        }
+        int shift = most_significant_bit(value) - sub_bits;
+        return static_cast<size_t>(shift) * sub_count + static_cast<size_t>(value >> shift);
+    }
+
+    static uint64_t upper_bound(size_t index) {
+        if (index < 2 * sub_count) {
+            return index;
+        }
+        int shift = static_cast<int>(index / sub_count) - 1;
+        uint64_t mantissa = index - static_cast<uint64_t>(shift) * sub_count;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    std::array<uint64_t, bucket_count> buckets_{};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t min_ = std::numeric_limits<uint64_t>::max();
+    uint64_t max_ = 0;
+};
+
+}  // namespace util
@@ -0,0 +1,473 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+#include "arena.h"
+#include "key_table.h"
+
+namespace util {
+
+/**
+ * @brief Flattens a json payload straight into a row of cells, without building a json value.
+ *
+ * Strings without escapes become views into the payload itself; strings with escapes are unescaped
+ * into the scratch arena. Arrays that are not expanded (non-numeric, of another length than first
+ * seen for their key, or all of them with `expand_arrays` off) are the exception: their text is
+ * handed to nlohmann and its dump stored in the scratch arena, so that their column holds exactly
+ * what flatten_json would write.
+ *
+ * The columns and values are those of decoding with nlohmann and calling flatten_json, and the
+ * input nlohmann rejects is rejected too, with a nlohmann::json::parse_error. A key repeated in an
+ * object is not read: the earlier value's columns are interned by the time the repeat shows up, so
+ * read() returns false and the caller decodes the message with nlohmann instead. Keys may already
+ * have been interned when it returns false or throws; callers roll the KeyTable back (see
+ * KeyTable::mark).
+ */
+class JsonRowReader {
+public:
+    static constexpr int max_depth = 512;
+
+    bool read(const char* data, size_t size, KeyTable& keys, std::vector<Cell>& row, Arena& scratch, bool expand_arrays = true) {
+        begin_ = p_ = data;
+        end_ = data + size;
+        keys_ = &keys;
+        row_ = &row;
+        scratch_ = &scratch;
+        expand_arrays_ = expand_arrays;
+        ++message_;
+        try {
+            read_message();
+        }
+        catch (const RepeatedKey&) {
+            return false;
+        }
+        return true;
+    }
+
+private:
+    // Thrown from deep inside the object being read to unwind out of read() on a repeated key.
+    struct RepeatedKey {};
+
+    void read_message() {
+        // a UTF-8 BOM, which json::parse skips too
+        if (end_ - p_ >= 3 && p_[0] == '\xef' && p_[1] == '\xbb' && p_[2] == '\xbf') {
+            p_ += 3;
+        }
+        skip_whitespace();
+        if (p_ == end_) {
+            fail("unexpected end of input");
+        }
+        if (*p_ == '{') {
+            read_object(KeyTable::root, 0);
+        } else if (*p_ == '[') {
+            // like flatten_json over json::items(): elements are keyed by their index
+            ++p_;
+            skip_whitespace();
+            if (peek() == ']') {
+                ++p_;
+            } else {
+                for (size_t i = 0;; ++i) {
+                    skip_whitespace();
+                    read_value(keys_->child(KeyTable::root, std::to_string(i)), 1);
+                    skip_whitespace();
+                    if (!separator(']')) {
+                        break;
+                    }
+                }
+            }
+        } else {
+            // a lone value is a single item with an empty key, except null, which has no items
+            if (peek() == 'n') {
+                literal("null");
+            } else {
+                read_value(keys_->child(KeyTable::root, ""), 0);
+            }
+        }
+        skip_whitespace();
+        if (p_ != end_) {
+            fail("unexpected characters after the value");
+        }
+    }
+
+    [[noreturn]] void fail(const char* what) const {
+        throw nlohmann::json::parse_error::create(101, static_cast<size_t>(p_ - begin_) + 1,
+                                                  std::string("syntax error while parsing value - ") + what, nullptr);
+    }
+
+    char peek() const { return p_ < end_ ? *p_ : '\0'; }
+
+    void skip_whitespace() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+            ++p_;
+        }
+    }
+
+    void expect(char c) {
+        if (peek() != c) {
+            fail("unexpected character");
+        }
+        ++p_;
+    }
+
+    // After an element: true on ',', false on `close` (consumed), fails otherwise.
+    bool separator(char close) {
+        char c = peek();
+        if (c == ',') {
+            ++p_;
+            return true;
+        }
+        if (c == close) {
+            ++p_;
+            return false;
+        }
+        fail("expected ',' or closing bracket");
+    }
+
+    void set(int node, const Cell& cell) {
+        size_t col = keys_->column(node);
+        set_row(*row_, col, keys_->size(), cell);
+    }
+
+    // Marks `node` as read in this message; when it already was, the key is repeated.
+    void visit(int node) {
+        if (visited_.size() < keys_->nodes()) {
+            visited_.resize(keys_->nodes(), 0);
+        }
+        uint64_t& mark = visited_[static_cast<size_t>(node)];
+        if (mark == message_) {
+            throw RepeatedKey{};
+        }
+        mark = message_;
+    }
+
+    void read_object(int node, int depth) {
+        if (depth >= max_depth) {
+            fail("nesting too deep");
+        }
+        expect('{');
+        skip_whitespace();
+        if (peek() == '}') {
+            ++p_;
+            return;
+        }
+        while (true) {
+            skip_whitespace();
+            if (peek() != '"') {
+                fail("expected a key");
+            }
+            std::string_view key = read_string();
+            skip_whitespace();
+            expect(':');
+            skip_whitespace();
+            int child = keys_->child(node, key);
+            visit(child);
+            read_value(child, depth + 1);
+            skip_whitespace();
+            if (!separator('}')) {
+                return;
+            }
+        }
+    }
+
+    // The value of the key at `node`: objects are flattened into it, everything else is its column.
+    void read_value(int node, int depth) {
+        switch (peek()) {
+            case '{': read_object(node, depth); break;
+            case '[': read_array(node, depth); break;
+            case '"': set(node, Cell::string(read_string())); break;
+            case 't': literal("true"); set(node, Cell::of(true)); break;
+            case 'f': literal("false"); set(node, Cell::of(false)); break;
+            case 'n': literal("null"); set(node, Cell::string("null")); break;
+            default: set(node, read_number()); break;
+        }
+    }
+
+    void read_array(int node, int depth) {
+        const char* start = p_;
+        if (expand_arrays_) {
+            ++p_;
+            numbers_.clear();
+            skip_whitespace();
+            bool numeric = peek() != ']';
+            while (numeric) {
+                skip_whitespace();
+                char c = peek();
+                if (c != '-' && (c < '0' || c > '9')) {
+                    numeric = false;
+                    break;
+                }
+                numbers_.push_back(read_number());
+                skip_whitespace();
+                if (!separator(']')) {
+                    break;
+                }
+            }
+            if (numeric && keys_->expands(node, numbers_.size())) {
+                for (size_t i = 0; i < numbers_.size(); ++i) {
+                    size_t col = keys_->column(keys_->element(node, i));
+                    set_row(*row_, col, keys_->size(), numbers_[i]);
+                }
+                return;
+            }
+            p_ = start;
+        }
+        // kept as json text, as nlohmann writes it (compact, object keys sorted, numbers normalized)
+        skip_value(depth);
+        auto value = arena_json::parse(start, p_);
+        set(node, Cell::string(scratch_->copy(value.dump())));
+    }
+
+    // Moves past one value, only checking what is needed to find its end; the caller validates it.
+    void skip_value(int depth) {
+        int open = 0;
+        do {
+            char c = peek();
+            if (c == '"') {
+                read_string();
+                continue;
+            }
+            if (c == '[' || c == '{') {
+                if (depth + ++open >= max_depth) {
+                    fail("nesting too deep");
+                }
+            } else if (c == ']' || c == '}') {
+                --open;
+            } else if (c == '\0' && p_ == end_) {
+                fail("unexpected end of input");
+            }
+            ++p_;
+        } while (open > 0);
+    }
+
+    void literal(std::string_view word) {
+        if (static_cast<size_t>(end_ - p_) < word.size() || std::string_view(p_, word.size()) != word) {
+            fail("invalid literal");
+        }
+        p_ += word.size();
+    }
+
+    // A json number, typed as nlohmann's lexer does: integers that fit are int64 (negative) or
+    // uint64, everything else is a double.
+    Cell read_number() {
+        const char* start = p_;
+        bool integer = true;
+        if (peek() == '-') {
+            ++p_;
+        }
+        if (peek() == '0') {
+            ++p_;
+        } else if (peek() >= '1' && peek() <= '9') {
+            skip_digits();
+        } else {
+            fail("invalid number");
+        }
+        if (peek() == '.') {
+            integer = false;
+            ++p_;
+            if (!skip_digits()) {
+                fail("invalid number");
+            }
+        }
+        if (peek() == 'e' || peek() == 'E') {
+            integer = false;
+            ++p_;
+            if (peek() == '+' || peek() == '-') {
+                ++p_;
+            }
+            if (!skip_digits()) {
+                fail("invalid number");
+            }
+        }
+
+        if (integer) {
+            if (*start == '-') {
+                int64_t value;
+                if (std::from_chars(start, p_, value).ec == std::errc()) {
+                    return Cell::of(value);
+                }
+            } else {
+                uint64_t value;
+                if (std::from_chars(start, p_, value).ec == std::errc()) {
+                    return Cell::of(value);
+                }
+            }
+        }
+        double value = 0;
+        auto result = std::from_chars(start, p_, value);
+        if (result.ec == std::errc::result_out_of_range) {
+            // underflow is (nearly) zero, as with nlohmann's strtod; overflow is rejected like nlohmann does
+            std::string text(start, p_);
+            value = std::strtod(text.c_str(), nullptr);
+            if (std::isinf(value)) {
+                throw nlohmann::json::out_of_range::create(406, "number overflow parsing '" + text + "'", nullptr);
+            }
+        }
+        return Cell::of(value);
+    }
+
+    bool skip_digits() {
+        const char* start = p_;
+        while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+            ++p_;
+        }
+        return p_ != start;
+    }
+
+    // Length of the UTF-8 sequence at `p`, or 0 if it is not one nlohmann accepts.
+    static size_t utf8_length(const unsigned char* p, const unsigned char* end) {
+        auto in = [&](size_t i, unsigned char lo, unsigned char hi) { return p + i < end && p[i] >= lo && p[i] <= hi; };
+        unsigned char c = p[0];
+        if (c >= 0xc2 && c <= 0xdf) return in(1, 0x80, 0xbf) ? 2 : 0;
+        if (c == 0xe0) return in(1, 0xa0, 0xbf) && in(2, 0x80, 0xbf) ? 3 : 0;
+        if ((c >= 0xe1 && c <= 0xec) || c == 0xee || c == 0xef) return in(1, 0x80, 0xbf) && in(2, 0x80, 0xbf) ? 3 : 0;
+        if (c == 0xed) return in(1, 0x80, 0x9f) && in(2, 0x80, 0xbf) ? 3 : 0;
+        if (c == 0xf0) return in(1, 0x90, 0xbf) && in(2, 0x80, 0xbf) && in(3, 0x80, 0xbf) ? 4 : 0;
+        if (c >= 0xf1 && c <= 0xf3) return in(1, 0x80, 0xbf) && in(2, 0x80, 0xbf) && in(3, 0x80, 0xbf) ? 4 : 0;
+        if (c == 0xf4) return in(1, 0x80, 0x8f) && in(2, 0x80, 0xbf) && in(3, 0x80, 0xbf) ? 4 : 0;
+        return 0;
+    }
+
+    // Reads a string starting at its opening quote; a view into the payload unless it has escapes.
+    std::string_view read_string() {
+        ++p_;
+        const char* start = p_;
+        bool escaped = false;
+        while (true) {
+            if (p_ >= end_) {
+                fail("unterminated string");
+            }
+            auto c = static_cast<unsigned char>(*p_);
+            if (c == '"') {
+                break;
+            }
+            if (c == '\\') {
+                escaped = true;
+                p_ += 2;
+            } else if (c < 0x20) {
+                fail("control character in string");
+            } else if (c < 0x80) {
+                ++p_;
+            } else {
+                size_t length = utf8_length(reinterpret_cast<const unsigned char*>(p_), reinterpret_cast<const unsigned char*>(end_));
+                if (length == 0) {
+                    fail("invalid UTF-8 in string");
+                }
+                p_ += length;
+            }
+        }
+        const char* stop = p_++;
+        if (!escaped) {
+            return std::string_view(start, stop - start);
+        }
+        return unescape(start, stop);
+    }
+
+    // Unescapes [start, stop) into the scratch arena; the result is never longer than the input.
+    std::string_view unescape(const char* start, const char* stop) {
+        char* out = static_cast<char*>(scratch_->allocate(static_cast<size_t>(stop - start), 1));
+        size_t n = 0;
+        for (const char* s = start; s < stop;) {
+            if (*s != '\\') {
+                out[n++] = *s++;
+                continue;
+            }
+            p_ = s;  // error position
+            char e = s + 1 < stop ? s[1] : '\0';
+            s += 2;
+            switch (e) {
+                case '"': out[n++] = '"'; break;
+                case '\\': out[n++] = '\\'; break;
+                case '/': out[n++] = '/'; break;
+                case 'b': out[n++] = '\b'; break;
+                case 'f': out[n++] = '\f'; break;
+                case 'n': out[n++] = '\n'; break;
+                case 'r': out[n++] = '\r'; break;
+                case 't': out[n++] = '\t'; break;
+                case 'u': {
+                    uint32_t code = hex4(s, stop);
+                    s += 4;
+                    if (code >= 0xd800 && code <= 0xdbff) {
+                        if (s + 1 >= stop || s[0] != '\\' || s[1] != 'u') {
+                            fail("surrogate U+D800..U+DBFF must be followed by U+DC00..U+DFFF");
+                        }
+                        uint32_t low = hex4(s + 2, stop);
+                        if (low < 0xdc00 || low > 0xdfff) {
+                            fail("surrogate U+D800..U+DBFF must be followed by U+DC00..U+DFFF");
+                        }
+                        s += 6;
+                        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    } else if (code >= 0xdc00 && code <= 0xdfff) {
+                        fail("surrogate U+DC00..U+DFFF must follow U+D800..U+DBFF");
+                    }
+                    n += encode_utf8(code, out + n);
+                    break;
+                }
+                default:
+                    fail("invalid escape in string");
+            }
+        }
+        p_ = stop + 1;
+        return std::string_view(out, n);
+    }
+
+    uint32_t hex4(const char* s, const char* stop) const {
+        if (stop - s < 4) {
+            fail("invalid \\u escape");
+        }
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = s[i];
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= static_cast<uint32_t>(c - '0');
+            else if (c >= 'a' && c <= 'f') value |= static_cast<uint32_t>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') value |= static_cast<uint32_t>(c - 'A' + 10);
+            else fail("invalid \\u escape");
+        }
+        return value;
+    }
+
+    // Writes `code` as UTF-8 (at most 4 bytes, never more than the 6 or 12 escape characters it replaces).
+    static size_t encode_utf8(uint32_t code, char* out) {
+        if (code < 0x80) {
+            out[0] = static_cast<char>(code);
+            return 1;
+        }
+        if (code < 0x800) {
+            out[0] = static_cast<char>(0xc0 | (code >> 6));
+            out[1] = static_cast<char>(0x80 | (code & 0x3f));
+            return 2;
+        }
+        if (code < 0x10000) {
+            out[0] = static_cast<char>(0xe0 | (code >> 12));
+            out[1] = static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out[2] = static_cast<char>(0x80 | (code & 0x3f));
+            return 3;
+        }
+        out[0] = static_cast<char>(0xf0 | (code >> 18));
+        out[1] = static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+        out[2] = static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+        out[3] = static_cast<char>(0x80 | (code & 0x3f));
+        return 4;
+    }
+
+    const char* begin_ = nullptr;
+    const char* p_ = nullptr;
+    const char* end_ = nullptr;
+    KeyTable* keys_ = nullptr;
+    std::vector<Cell>* row_ = nullptr;
+    Arena* scratch_ = nullptr;
+    bool expand_arrays_ = true;
+    std::vector<Cell> numbers_;  // elements of the array being read
+    std::vector<uint64_t> visited_;  // per key node, the last message that had it
+    uint64_t message_ = 0;
+};
+
+}  // namespace util
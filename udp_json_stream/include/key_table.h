@@ -0,0 +1,271 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+#include "nlohmann/json.hpp"
+#include "arena.h"
+
+namespace util {
+
+/**
+ * @brief Interns flattened key paths ("nested.key") into stable column indices.
+ *
+ * Every object level is a node of a trie whose children are looked up by the plain key,
+ * so the dotted path is only joined once, when a column is first seen.
+ * Flattening a message whose keys are all known does not allocate.
+ */
+class KeyTable {
+public:
+    static constexpr int root = 0;
+
+    KeyTable() : nodes_(1) {}
+
+    // Returns the node of `key` under `parent`, creating it on first sight.
+    int child(int parent, std::string_view key) {
+        auto& children = nodes_[parent].children;
+        auto it = children.find(key);
+        if (it != children.end()) {
+            return it->second;
+        }
+        int id = static_cast<int>(nodes_.size());
+        std::string path = nodes_[parent].path.empty() ? std::string(key) : nodes_[parent].path + "." + std::string(key);
+        children.emplace(std::string(key), id);
+        nodes_.push_back(Node{std::move(path), {}, -1, {}, 0});
+        return id;
+    }
+
+    // Returns the column index of a leaf node, assigning one on first use.
+    size_t column(int node) {
+        int& col = nodes_[node].column;
+        if (col < 0) {
+            // different nodes may spell the same path, e.g. {"a.b": 1} and {"a": {"b": 2}}
+            auto it = by_name_.find(nodes_[node].path);
+            if (it == by_name_.end()) {
+                it = by_name_.emplace(nodes_[node].path, names_.size()).first;
+                names_.push_back(nodes_[node].path);
+            }
+            col = static_cast<int>(it->second);
+        }
+        return static_cast<size_t>(col);
+    }
+
+    size_t column(std::string_view key) { return column(child(root, key)); }
+
+    // Returns the node of the `index`-th element of an array under `parent`.
+    // Elements are named by their index unless names were given for the array's path.
+    int element(int parent, size_t index) {
+        auto& elements = nodes_[parent].elements;
+        if (index < elements.size() && elements[index] >= 0) {
+            return elements[index];
+        }
+        std::string key = std::to_string(index);
+        auto names = element_names_.find(nodes_[parent].path);
+        if (names != element_names_.end() && index < names->second.size()) {
+            key = names->second[index];
+        }
+        int id = child(parent, key);
+        // `child` may reallocate nodes_
+        auto& grown = nodes_[parent].elements;
+        if (index >= grown.size()) {
+            grown.resize(index + 1, -1);
+        }
+        grown[index] = id;
+        return id;
+    }
+
+    // Whether a numeric array of `length` at `node` is expanded: only at the length first seen there,
+    // so that a variable-length array is one column of json text rather than a new schema per length.
+    bool expands(int node, size_t length) {
+        size_t& fixed = nodes_[node].array_length;
+        if (fixed == 0) {
+            fixed = length;
+        }
+        return length == fixed;
+    }
+
+    // Names the elements of numeric arrays at `path`, e.g. "location" -> {"x", "y", "z"}.
+    void set_element_names(const std::string& path, std::vector<std::string> names) {
+        element_names_[path] = std::move(names);
+    }
+
+    // Column of an existing path, or npos if no message carried it yet.
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    size_t find(std::string_view name) const {
+        auto it = by_name_.find(name);
+        return it == by_name_.end() ? npos : it->second;
+    }
+
+    // State to return to with rollback(), e.g. when a message turns out to be malformed halfway.
+    struct Mark {
+        size_t nodes;
+        size_t columns;
+    };
+
+    Mark mark() const { return Mark{nodes_.size(), names_.size()}; }
+
+    // Forgets every node and column added since `mark`.
+    void rollback(const Mark& mark) {
+        if (nodes_.size() == mark.nodes && names_.size() == mark.columns) {
+            return;
+        }
+        for (size_t i = mark.columns; i < names_.size(); ++i) {
+            by_name_.erase(names_[i]);
+        }
+        names_.resize(mark.columns);
+        nodes_.resize(mark.nodes);
+        const int nodes = static_cast<int>(mark.nodes);
+        for (auto& node : nodes_) {
+            if (node.column >= static_cast<int>(mark.columns)) {
+                node.column = -1;
+            }
+            for (auto it = node.children.begin(); it != node.children.end();) {
+                it = it->second >= nodes ? node.children.erase(it) : std::next(it);
+            }
+            for (int& element : node.elements) {
+                if (element >= nodes) {
+                    // the array's length was first seen in the forgotten message
+                    element = -1;
+                    node.array_length = 0;
+                }
+            }
+        }
+    }
+
+    size_t size() const { return names_.size(); }
+    size_t nodes() const { return nodes_.size(); }
+    const std::string& name(size_t column) const { return names_[column]; }
+
+    // Column indices [begin, end) ordered by name, i.e. the order nlohmann's std::map would give.
+    std::vector<size_t> sorted_columns(size_t begin, size_t end) const {
+        std::vector<size_t> columns;
+        for (size_t i = begin; i < end; ++i) {
+            columns.push_back(i);
+        }
+        std::sort(columns.begin(), columns.end(), [this](size_t a, size_t b) { return names_[a] < names_[b]; });
+        return columns;
+    }
+
+private:
+    struct Node {
+        std::string path;
+        std::map<std::string, int, std::less<>> children;
+        int column;
+        std::vector<int> elements;
+        size_t array_length;  // of the expanded numeric arrays, 0 until one is seen
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<std::string> names_;
+    std::map<std::string, size_t, std::less<>> by_name_;
+    std::map<std::string, std::vector<std::string>> element_names_;
+};
+
+/**
+ * @brief One value of a flattened row.
+ *
+ * Strings are views: into the payload, the decoded message or a scratch Arena, each of which
+ * outlives the row until it is written. Values that are neither strings, numbers nor booleans
+ * (null, non-numeric arrays) are kept as their json text and written like strings.
+ */
+struct Cell {
+    enum class Type : uint8_t { empty, string, boolean, integer, unsigned_integer, floating };
+
+    Type type = Type::empty;
+    union {
+        bool boolean;
+        int64_t integer;
+        uint64_t unsigned_integer;
+        double floating;
+    };
+    std::string_view text;
+
+    Cell() : integer(0) {}
+    static Cell string(std::string_view text) { Cell c; c.type = Type::string; c.text = text; return c; }
+    static Cell of(bool value) { Cell c; c.type = Type::boolean; c.boolean = value; return c; }
+    static Cell of(int64_t value) { Cell c; c.type = Type::integer; c.integer = value; return c; }
+    static Cell of(uint64_t value) { Cell c; c.type = Type::unsigned_integer; c.unsigned_integer = value; return c; }
+    static Cell of(double value) { Cell c; c.type = Type::floating; c.floating = value; return c; }
+
+    bool empty() const { return type == Type::empty; }
+    bool is_integer() const { return type == Type::integer || type == Type::unsigned_integer; }
+    bool is_number() const { return is_integer() || type == Type::floating; }
+    double as_double() const {
+        switch (type) {
+            case Type::integer: return static_cast<double>(integer);
+            case Type::unsigned_integer: return static_cast<double>(unsigned_integer);
+            case Type::floating: return floating;
+            default: return 0.0;
+        }
+    }
+};
+
+// The cell of a decoded json value; json text that has to be produced is stored in `scratch`.
+template <typename Json>
+inline Cell make_cell(const Json& value, Arena& scratch) {
+    switch (value.type()) {
+        case nlohmann::json::value_t::string:
+            return Cell::string(value.template get_ref<const typename Json::string_t&>());
+        case nlohmann::json::value_t::boolean:
+            return Cell::of(value.template get<bool>());
+        case nlohmann::json::value_t::number_integer:
+            return Cell::of(value.template get<int64_t>());
+        case nlohmann::json::value_t::number_unsigned:
+            return Cell::of(value.template get<uint64_t>());
+        case nlohmann::json::value_t::number_float:
+            return Cell::of(value.template get<double>());
+        default:
+            return Cell::string(scratch.copy(value.dump()));
+    }
+}
+
+template <typename Json>
+inline bool is_numeric_array(const Json& j) {
+    if (!j.is_array() || j.empty()) {
+        return false;
+    }
+    for (const auto& el : j) {
+        if (!el.is_number()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline void set_row(std::vector<Cell>& row, size_t col, size_t columns, const Cell& value) {
+    if (col >= row.size()) {
+        row.resize(columns);
+    }
+    row[col] = value;
+}
+
+// Flattens a (nested) json object into `row`, indexed by the interned column of each leaf.
+// Numeric arrays are expanded into one column per element when `expand_arrays` is set and they
+// have the length first seen for their key (see KeyTable::expands); other arrays stay a single
+// column holding their json text.
+// `row` is expected to be cleared by the caller; it only grows when a new column appears.
+// The cells refer to `j` and `scratch`, which must outlive the row.
+template <typename Json>
+inline void flatten_json(const Json& j, KeyTable& keys, int node, std::vector<Cell>& row, Arena& scratch, bool expand_arrays = true) {
+    for (auto& el : j.items()) {
+        int child = keys.child(node, el.key());
+        const auto& value = el.value();
+        if (value.is_object()) {
+            flatten_json(value, keys, child, row, scratch, expand_arrays);
+        } else if (expand_arrays && is_numeric_array(value) && keys.expands(child, value.size())) {
+            for (size_t i = 0; i < value.size(); ++i) {
+                size_t col = keys.column(keys.element(child, i));
+                set_row(row, col, keys.size(), make_cell(value[i], scratch));
+            }
+        } else {
+            size_t col = keys.column(child);
+            set_row(row, col, keys.size(), make_cell(value, scratch));
+        }
+    }
+}
+
+}  // namespace util
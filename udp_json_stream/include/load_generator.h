@@ -0,0 +1,330 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+#include "socket.h"
+#include "payload.h"
+
+namespace util {
+
+// Values the sequence number and send time are serialized with before being patched per message.
+// Both take 20 characters in json and a fixed 8 byte big-endian uint64 in cbor/msgpack.
+constexpr uint64_t seq_placeholder = 0xFFFFFFFFFFFFFFFFull;
+constexpr uint64_t time_placeholder = 0xFFFFFFFFFFFFFFFEull;
+constexpr size_t json_number_width = 20;
+
+/**
+ * @brief A pre-serialized payload with the positions of its sequence number and send time.
+ */
+struct PayloadTemplate {
+    std::vector<char> bytes;
+    Encoding encoding = Encoding::json;
+    size_t seq_offset = std::string::npos;
+    size_t time_offset = std::string::npos;
+
+    // Writes `seq` and `time_us` into `data`, a copy of `bytes`.
+    void patch(char* data, uint64_t seq, uint64_t time_us) const {
+        patch_number(data, seq_offset, seq);
+        patch_number(data, time_offset, time_us);
+    }
+
+private:
+    void patch_number(char* data, size_t offset, uint64_t value) const {
+        if (offset == std::string::npos) {
+            return;
+        }
+        if (encoding == Encoding::json) {
+            // right aligned, padded with (valid json) whitespace
+            char* end = data + offset + json_number_width;
+            char* p = end;
+            do {
+                *--p = static_cast<char>('0' + value % 10);
+                value /= 10;
+            } while (value != 0);
+            std::memset(data + offset, ' ', p - (data + offset));
+        } else {
+            for (int i = 7; i >= 0; --i) {
+                data[offset + i] = static_cast<char>(value & 0xFF);
+                value >>= 8;
+            }
+        }
+    }
+};
+
+inline size_t find_placeholder(const std::vector<char>& bytes, Encoding encoding, uint64_t placeholder) {
+    std::string pattern;
+    size_t skip = 0;
+    if (encoding == Encoding::json) {
+        pattern = std::to_string(placeholder);
+    } else {
+        // cbor: 0x1b (uint64 follows), msgpack: 0xcf (uint64 follows)
+        pattern.push_back(static_cast<char>(encoding == Encoding::cbor ? 0x1b : 0xcf));
+        for (int i = 7; i >= 0; --i) {
+            pattern.push_back(static_cast<char>((placeholder >> (i * 8)) & 0xFF));
+        }
+        skip = 1;
+    }
+    auto it = std::search(bytes.begin(), bytes.end(), pattern.begin(), pattern.end());
+    return it == bytes.end() ? std::string::npos : static_cast<size_t>(it - bytes.begin()) + skip;
+}
+
+// Serializes `message` once with placeholders in `seq_field` and `time_field`.
+// If `payload_size` is larger than the message, a "pad" string brings the payload up to about that size.
+inline PayloadTemplate make_template(nlohmann::json message, Encoding encoding, const std::string& seq_field,
+                                     const std::string& time_field, size_t payload_size = 0) {
+    if (!seq_field.empty()) {
+        message[seq_field] = seq_placeholder;
+    }
+    if (!time_field.empty()) {
+        message[time_field] = time_placeholder;
+    }
+    std::vector<uint8_t> encoded = encode_payload(message, encoding);
+    const size_t pad_overhead = 16;  // key, quotes and length header of the pad field
+    if (encoded.size() + pad_overhead < payload_size) {
+        message["pad"] = std::string(payload_size - encoded.size() - pad_overhead, 'x');
+        encoded = encode_payload(message, encoding);
+    }
+
+    PayloadTemplate payload;
+    payload.bytes.assign(encoded.begin(), encoded.end());
+    payload.encoding = encoding;
+    if (!seq_field.empty()) {
+        payload.seq_offset = find_placeholder(payload.bytes, encoding, seq_placeholder);
+    }
+    if (!time_field.empty()) {
+        payload.time_offset = find_placeholder(payload.bytes, encoding, time_placeholder);
+    }
+    return payload;
+}
+
+// Splits one csv line into fields, undoing the "" escaping of quoted fields.
+// `quoted` tells whether each field was quoted, i.e. written as a string.
+inline std::vector<std::string> split_csv_line(const std::string& line, std::vector<bool>& quoted) {
+    std::vector<std::string> fields(1);
+    quoted.assign(1, false);
+    bool in_quotes = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (in_quotes) {
+            if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                fields.back() += '"';
+                ++i;
+            } else if (c == '"') {
+                in_quotes = false;
+            } else {
+                fields.back() += c;
+            }
+        } else if (c == '"') {
+            in_quotes = true;
+            quoted.back() = true;
+        } else if (c == ',') {
+            fields.emplace_back();
+            quoted.push_back(false);
+        } else if (c != '\r') {
+            fields.back() += c;
+        }
+    }
+    return fields;
+}
+
+// Turns the rows of a csv written by the listener (e.g. ble.csv) back into messages.
+// Dotted column names become nested objects, json text columns are parsed back, ArrivalTimeUs is dropped.
+inline std::vector<nlohmann::json> load_csv_messages(const std::string& filename) {
+    std::vector<nlohmann::json> messages;
+    std::ifstream file(filename);
+    std::string line;
+    std::vector<bool> quoted;
+    if (!std::getline(file, line)) {
+        return messages;
+    }
+    std::vector<std::string> header = split_csv_line(line, quoted);
+
+    while (std::getline(file, line)) {
+        std::vector<std::string> fields = split_csv_line(line, quoted);
+        nlohmann::json message = nlohmann::json::object();
+        for (size_t i = 0; i < header.size() && i < fields.size(); ++i) {
+            if (header[i] == "ArrivalTimeUs" || (fields[i].empty() && !quoted[i])) {
+                continue;
+            }
+            nlohmann::json value;
+            bool is_json_text = !fields[i].empty() && (fields[i][0] == '[' || fields[i][0] == '{');
+            if (!quoted[i] || is_json_text) {
+                value = nlohmann::json::parse(fields[i], nullptr, false);
+                if (value.is_discarded()) {
+                    value = fields[i];
+                }
+            } else {
+                value = fields[i];
+            }
+            nlohmann::json* node = &message;
+            size_t begin = 0;
+            for (size_t dot = header[i].find('.'); dot != std::string::npos; dot = header[i].find('.', begin)) {
+                node = &(*node)[header[i].substr(begin, dot - begin)];
+                begin = dot + 1;
+            }
+            (*node)[header[i].substr(begin)] = value;
+        }
+        messages.push_back(message);
+    }
+    return messages;
+}
+
+struct LoadOptions {
+    double rate = 0;          // messages per second over all threads, 0 for as fast as possible
+    int threads = 1;          // sender threads, each with its own socket (i.e. source port) and sequence
+    size_t batch = 1;         // messages per sendmmsg
+    double duration = 0;      // seconds, 0 for no limit
+};
+
+/**
+ * @brief Sends pre-serialized payloads at a target rate from several threads.
+ *
+ * Every thread cycles through its own copy of the templates and only patches the sequence number
+ * and send time (system clock, microseconds since epoch) in place before sending.
+ */
+class LoadGenerator {
+public:
+    LoadGenerator(const sockaddr_in& target, std::vector<PayloadTemplate> templates, const LoadOptions& options)
+        : target_(target), templates_(std::move(templates)), options_(options) {}
+
+    ~LoadGenerator() {
+        stop();
+        join();
+    }
+
+    void start() {
+        running_ = true;
+        for (int i = 0; i < options_.threads; ++i) {
+            workers_.emplace_back(&LoadGenerator::worker, this);
+        }
+    }
+
+    void stop() { running_ = false; }
+
+    void join() {
+        for (auto& worker : workers_) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+        workers_.clear();
+    }
+
+    bool running() const { return running_; }
+    uint64_t sent() const { return sent_; }
+    uint64_t bytes() const { return bytes_; }
+    uint64_t failed() const { return failed_; }
+
+private:
+    void worker() {
+        SocketType sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sock == INVALID_SOCK) {
+            std::cerr << "Failed to create socket\n";
+            return;
+        }
+
+        // private copies of the templates, repeated so that one batch never uses a copy twice
+        const size_t batch = options_.batch;
+        const size_t repeat = (batch + templates_.size() - 1) / templates_.size();
+        std::vector<std::vector<char>> payloads;
+        for (size_t r = 0; r < repeat; ++r) {
+            for (const auto& payload : templates_) {
+                payloads.push_back(payload.bytes);
+            }
+        }
+        std::vector<char*> batch_data(batch);
+        std::vector<size_t> batch_size(batch);
+#ifndef _WIN32
+        std::vector<mmsghdr> msgs(batch);
+        std::vector<iovec> iovecs(batch);
+#endif
+
+        using clock = std::chrono::steady_clock;
+        const auto start = clock::now();
+        const auto interval = options_.rate > 0
+            ? std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(batch * options_.threads / options_.rate))
+            : clock::duration::zero();
+        auto next = start;
+        uint64_t seq = 0;
+
+        while (running_) {
+            auto now = clock::now();
+            if (options_.duration > 0 && now - start >= std::chrono::duration<double>(options_.duration)) {
+                running_ = false;
+                break;
+            }
+            if (interval != clock::duration::zero()) {
+                if (next > now) {
+                    std::this_thread::sleep_until(next);
+                } else if (now - next > std::chrono::milliseconds(100)) {
+                    next = now;  // fell far behind: do not burst to catch up
+                }
+                next += interval;
+            }
+
+            for (size_t i = 0; i < batch; ++i, ++seq) {
+                std::vector<char>& data = payloads[seq % payloads.size()];
+                auto time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+                templates_[seq % templates_.size()].patch(data.data(), seq, static_cast<uint64_t>(time_us));
+                batch_data[i] = data.data();
+                batch_size[i] = data.size();
+            }
+
+#ifdef _WIN32
+            for (size_t i = 0; i < batch; ++i) {
+                int sent = sendto(sock, batch_data[i], static_cast<int>(batch_size[i]), 0, (struct sockaddr*)&target_, sizeof(target_));
+                if (sent == SOCKET_ERROR_CODE) {
+                    ++failed_;
+                } else {
+                    ++sent_;
+                    bytes_ += sent;
+                }
+            }
+#else
+            for (size_t i = 0; i < batch; ++i) {
+                iovecs[i].iov_base = batch_data[i];
+                iovecs[i].iov_len = batch_size[i];
+                msgs[i] = {};
+                msgs[i].msg_hdr.msg_name = &target_;
+                msgs[i].msg_hdr.msg_namelen = sizeof(target_);
+                msgs[i].msg_hdr.msg_iov = &iovecs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            int sent = sendmmsg(sock, msgs.data(), static_cast<unsigned int>(batch), 0);
+            if (sent < 0) {
+                failed_ += batch;
+                continue;
+            }
+            failed_ += batch - sent;
+            sent_ += sent;
+            for (int i = 0; i < sent; ++i) {
+                bytes_ += msgs[i].msg_len;
+            }
+#endif
+        }
+
+        CLOSE_SOCKET(sock);
+    }
+
+    sockaddr_in target_;
+    std::vector<PayloadTemplate> templates_;
+    LoadOptions options_;
+    std::vector<std::thread> workers_;
+    std::atomic<bool> running_{false};
+    std::atomic<uint64_t> sent_{0};
+    std::atomic<uint64_t> bytes_{0};
+    std::atomic<uint64_t> failed_{0};
+};
+
+}  // namespace util
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+namespace util {
+
+enum class Encoding { unknown, json, cbor, msgpack };
+
+inline const char* encoding_name(Encoding encoding) {
+    switch (encoding) {
+        case Encoding::json: return "json";
+        case Encoding::cbor: return "cbor";
+        case Encoding::msgpack: return "msgpack";
+        default: return "unknown";
+    }
+}
+
+inline Encoding parse_encoding(const std::string& name) {
+    if (name == "json") return Encoding::json;
+    if (name == "cbor") return Encoding::cbor;
+    if (name == "msgpack") return Encoding::msgpack;
+    return Encoding::unknown;
+}
+
+// Guesses the encoding of a payload from its first byte. Payloads are expected to be maps (objects):
+// json starts with '{' (or '['), after a UTF-8 BOM and whitespace if any, as json::parse allows;
+// cbor with a map header 0xa0-0xbf (or the 0xd9d9f7 self-describe tag), msgpack with a fixmap
+// 0x80-0x8f or map16/map32 (0xde, 0xdf). The ranges do not overlap, nor does the BOM's 0xef.
+inline Encoding detect_encoding(const char* data, size_t size) {
+    size_t i = 0;
+    if (size >= 3 && data[0] == '\xef' && data[1] == '\xbb' && data[2] == '\xbf') {
+        i = 3;
+    }
+    while (i < size && (data[i] == ' ' || data[i] == '\t' || data[i] == '\r' || data[i] == '\n')) {
+        ++i;
+    }
+    if (i == size) {
+        return Encoding::unknown;
+    }
+    const auto first = static_cast<uint8_t>(data[i]);
+    if (first == '{' || first == '[') {
+        return Encoding::json;
+    }
+    if ((first >= 0xa0 && first <= 0xbf) || first == 0xd9) {
+        return Encoding::cbor;
+    }
+    if ((first >= 0x80 && first <= 0x8f) || first == 0xde || first == 0xdf) {
+        return Encoding::msgpack;
+    }
+    return Encoding::unknown;
+}
+
+// Decodes a payload of any supported encoding into a json value (of any basic_json type).
+// Throws nlohmann::json::parse_error on malformed input, like json::parse.
+template <typename Json = nlohmann::json>
+inline Json decode_payload(const char* data, size_t size, Encoding encoding) {
+    const auto* begin = reinterpret_cast<const uint8_t*>(data);
+    switch (encoding) {
+        case Encoding::cbor:
+            return Json::from_cbor(begin, begin + size);
+        case Encoding::msgpack:
+            return Json::from_msgpack(begin, begin + size);
+        default:
+            return Json::parse(data, data + size);
+    }
+}
+
+// Encodes a json value for the wire.
+inline std::vector<uint8_t> encode_payload(const nlohmann::json& message, Encoding encoding) {
+    switch (encoding) {
+        case Encoding::cbor:
+            return nlohmann::json::to_cbor(message);
+        case Encoding::msgpack:
+            return nlohmann::json::to_msgpack(message);
+        default: {
+            std::string text = message.dump();
+            return std::vector<uint8_t>(text.begin(), text.end());
+        }
+    }
+}
+
+}  // namespace util
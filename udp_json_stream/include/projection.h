@@ -0,0 +1,263 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+#include "payload.h"
+
+namespace util {
+
+/**
+ * @brief A set of json pointers (e.g. "/location", "/tagId") to keep from each message.
+ *
+ * Stored as a trie of reference tokens so that the decoder can tell, key by key, whether a
+ * subtree is kept, may contain something kept, or can be skipped.
+ */
+class Projection {
+public:
+    struct Node {
+        std::map<std::string, Node, std::less<>> children;
+        bool selected = false;
+    };
+
+    Projection() = default;
+
+    explicit Projection(const std::vector<std::string>& pointers) {
+        for (const auto& pointer : pointers) {
+            add(pointer);
+        }
+    }
+
+    // Throws nlohmann::json::parse_error if `pointer` is not a valid json pointer.
+    void add(const std::string& pointer) {
+        nlohmann::json::json_pointer parsed(pointer);
+        Node* node = &root_;
+        // walk the unescaped reference tokens ("~1" -> "/", "~0" -> "~")
+        std::vector<std::string> tokens;
+        for (auto p = parsed; !p.empty(); p = p.parent_pointer()) {
+            tokens.insert(tokens.begin(), p.back());
+        }
+        for (const auto& t : tokens) {
+            node = &node->children[t];
+        }
+        node->selected = true;
+    }
+
+    bool empty() const { return root_.children.empty() && !root_.selected; }
+    const Node& root() const { return root_; }
+
+private:
+    Node root_;
+};
+
+/**
+ * @brief SAX handler that only builds the parts of a message selected by a Projection.
+ *
+ * Skipped subtrees are still scanned by the lexer, but no json value is created for them.
+ * Kept subtrees are stored at their original place in `result`, inside objects and arrays of the
+ * same types as in the message, so flattening them gives the same column names as the full message
+ * would. A token is an array index or an object key depending on what the message has there; the
+ * elements of an array before a kept one are null.
+ */
+template <typename Json = nlohmann::json>
+class ProjectionSax {
+public:
+    using json = Json;
+
+    ProjectionSax(const Projection& projection, json& result) : projection_(projection), result_(result) {
+        result_ = json::object();
+    }
+
+    bool null() { return value(nullptr); }
+    bool boolean(bool val) { return value(val); }
+    bool number_integer(typename json::number_integer_t val) { return value(val); }
+    bool number_unsigned(typename json::number_unsigned_t val) { return value(val); }
+    bool number_float(typename json::number_float_t val, const typename json::string_t&) { return value(val); }
+    bool string(typename json::string_t& val) { return value(val); }
+    bool binary(typename json::binary_t& val) { return value(json::binary(val)); }
+
+    bool start_object(std::size_t) { return start(json::value_t::object); }
+    bool start_array(std::size_t) { return start(json::value_t::array); }
+    bool end_object() { return end(); }
+    bool end_array() { return end(); }
+
+    bool key(typename json::string_t& val) {
+        if (skip_depth_ > 0) {
+            return true;
+        }
+        Frame& frame = frames_.back();
+        if (frame.target) {
+            key_ = val;
+        } else {
+            auto it = frame.node->children.find(val);
+            next_ = it == frame.node->children.end() ? nullptr : &it->second;
+            if (next_) {
+                key_ = val;
+            }
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) {
+        // rethrow with its concrete type, as json::parse does
+        switch ((ex.id / 100) % 100) {
+            case 1: throw *static_cast<const typename json::parse_error*>(&ex);
+            case 4: throw *static_cast<const typename json::out_of_range*>(&ex);
+            default: throw *static_cast<const typename json::other_error*>(&ex);
+        }
+    }
+
+private:
+    struct Frame {
+        const Projection::Node* node;  // while looking for selected paths
+        json* target;                  // while building a selected subtree
+        bool is_array;
+        size_t index;                  // of the next element, in arrays
+        // while looking: this container's copy in `result_`, made once something under it is kept,
+        // and where that goes in the parent's copy
+        json* partial = nullptr;
+        typename json::string_t key = {};
+        size_t position = 0;
+    };
+
+    // The projection node of the value about to be read, or nullptr if it is not wanted.
+    const Projection::Node* next_node() {
+        if (frames_.empty()) {
+            return &projection_.root();
+        }
+        Frame& frame = frames_.back();
+        if (!frame.is_array) {
+            return next_;
+        }
+        char digits[24];
+        auto end = std::to_chars(digits, digits + sizeof(digits), frame.index++).ptr;
+        auto it = frame.node->children.find(std::string_view(digits, end - digits));
+        return it == frame.node->children.end() ? nullptr : &it->second;
+    }
+
+    // Where a selected value found while looking goes, creating the containers above it in `result_`.
+    json& selected_slot() {
+        for (size_t i = 0; i < frames_.size(); ++i) {
+            Frame& frame = frames_[i];
+            if (frame.partial) {
+                continue;
+            }
+            json& slot = i == 0 ? result_ : element(frames_[i - 1], frame.key, frame.position);
+            slot = json(frame.is_array ? json::value_t::array : json::value_t::object);
+            frame.partial = &slot;
+        }
+        Frame& frame = frames_.back();
+        return element(frame, key_, frame.index - 1);
+    }
+
+    static json& element(Frame& frame, const typename json::string_t& key, size_t position) {
+        if (!frame.is_array) {
+            return (*frame.partial)[key];
+        }
+        while (frame.partial->size() <= position) {
+            frame.partial->push_back(nullptr);
+        }
+        return (*frame.partial)[position];
+    }
+
+    // Where the next value of the subtree being built goes.
+    json& next_slot() {
+        Frame& frame = frames_.back();
+        if (frame.is_array) {
+            frame.target->push_back(nullptr);
+            return frame.target->back();
+        }
+        return (*frame.target)[key_];
+    }
+
+    template <typename T>
+    bool value(T&& val) {
+        if (skip_depth_ > 0) {
+            return true;
+        }
+        if (!frames_.empty() && frames_.back().target) {
+            next_slot() = std::forward<T>(val);
+            return true;
+        }
+        const Projection::Node* node = next_node();
+        if (node && node->selected) {
+            (frames_.empty() ? result_ : selected_slot()) = std::forward<T>(val);
+        }
+        return true;
+    }
+
+    bool start(typename json::value_t type) {
+        if (skip_depth_ > 0) {
+            ++skip_depth_;
+            return true;
+        }
+        const bool is_array = type == json::value_t::array;
+        if (!frames_.empty() && frames_.back().target) {
+            json& slot = next_slot();
+            slot = json(type);
+            frames_.push_back(Frame{nullptr, &slot, is_array, 0});
+            return true;
+        }
+        const Projection::Node* node = next_node();
+        if (!node) {
+            skip_depth_ = 1;
+        } else if (node->selected) {
+            json& slot = frames_.empty() ? result_ : selected_slot();
+            slot = json(type);
+            frames_.push_back(Frame{nullptr, &slot, is_array, 0});
+        } else if (frames_.empty()) {
+            frames_.push_back(Frame{node, nullptr, is_array, 0});
+        } else {
+            const Frame& parent = frames_.back();
+            frames_.push_back(Frame{node, nullptr, is_array, 0, nullptr, parent.is_array ? typename json::string_t() : key_,
+                                    parent.is_array ? parent.index - 1 : 0});
+        }
+        return true;
+    }
+
+    bool end() {
+        if (skip_depth_ > 0) {
+            --skip_depth_;
+            return true;
+        }
+        frames_.pop_back();
+        return true;
+    }
+
+    const Projection& projection_;
+    json& result_;
+    std::vector<Frame> frames_;
+    const Projection::Node* next_ = nullptr;
+    typename json::string_t key_;
+    size_t skip_depth_ = 0;
+};
+
+// Decodes only the parts of a payload selected by `projection`.
+// Throws nlohmann::json::parse_error on malformed input, like decode_payload.
+template <typename Json = nlohmann::json>
+inline Json decode_projected(const char* data, size_t size, Encoding encoding, const Projection& projection) {
+    Json result;
+    ProjectionSax<Json> sax(projection, result);
+    const auto* begin = reinterpret_cast<const uint8_t*>(data);
+    switch (encoding) {
+        case Encoding::cbor:
+            Json::sax_parse(begin, begin + size, &sax, Json::input_format_t::cbor);
+            break;
+        case Encoding::msgpack:
+            Json::sax_parse(begin, begin + size, &sax, Json::input_format_t::msgpack);
+            break;
+        default:
+            Json::sax_parse(data, data + size, &sax);
+            break;
+    }
+    return result;
+}
+
+}  // namespace util
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "socket.h"
+
+namespace util {
+
+// Largest payload a UDP datagram can carry over IPv4.
+constexpr size_t max_datagram_size = 65507;
+
+struct ReceiveStats {
+    uint64_t datagrams = 0;
+    uint64_t bytes = 0;
+    uint64_t truncated = 0;   // cut off by the receive buffer, never parsed
+    uint64_t malformed = 0;   // complete, but not a valid payload
+};
+
+/**
+ * @brief Fixed set of equally sized buffers, allocated once and handed out again after release.
+ *
+ * Memory is bounded by count * size; acquire() returns nullptr when every buffer is in use.
+ */
+class BufferPool {
+public:
+    BufferPool(size_t count, size_t size) : size_(size), storage_(count * size) {
+        for (size_t i = 0; i < count; ++i) {
+            free_.push_back(storage_.data() + i * size);
+        }
+    }
+
+    char* acquire() {
+        if (free_.empty()) {
+            return nullptr;
+        }
+        char* buffer = free_.back();
+        free_.pop_back();
+        return buffer;
+    }
+
+    void release(char* buffer) { free_.push_back(buffer); }
+
+    size_t buffer_size() const { return size_; }
+    size_t available() const { return free_.size(); }
+
+private:
+    size_t size_;
+    std::vector<char> storage_;
+    std::vector<char*> free_;
+};
+
+struct Datagram {
+    const char* data;
+    size_t size;        // bytes stored in data
+    bool truncated;     // the datagram did not fit in the buffer and was cut off
+    sockaddr_in from;
+};
+
+/**
+ * @brief Receives batches of datagrams into buffers taken from a BufferPool.
+ *
+ * On Linux a batch is read with a single recvmmsg() and truncation is reported through MSG_TRUNC;
+ * elsewhere one datagram is read per call and truncation shows up as WSAEMSGSIZE.
+ * The receiver holds `batch` buffers of the pool for its lifetime, so memory stays bounded.
+ */
+class DatagramReceiver {
+public:
+    DatagramReceiver(SocketType sock, BufferPool& pool, size_t batch)
+        : DatagramReceiver(pool, batch) {
+        sock_ = sock;
+    }
+
+    // Without a socket of its own, for receiving from whichever socket is ready (see EventLoop).
+    DatagramReceiver(BufferPool& pool, size_t batch)
+        : pool_(pool) {
+#ifdef _WIN32
+        batch = 1;
+#endif
+        datagrams_.resize(batch);
+        for (size_t i = 0; i < batch; ++i) {
+            char* buffer = pool_.acquire();
+            if (!buffer) {
+                datagrams_.resize(i);
+                break;
+            }
+            buffers_.push_back(buffer);
+        }
+#ifndef _WIN32
+        msgs_.resize(buffers_.size());
+        iovecs_.resize(buffers_.size());
+#endif
+    }
+
+    ~DatagramReceiver() {
+        for (char* buffer : buffers_) {
+            pool_.release(buffer);
+        }
+    }
+
+    DatagramReceiver(const DatagramReceiver&) = delete;
+    DatagramReceiver& operator=(const DatagramReceiver&) = delete;
+
+    // Blocks until at least one datagram arrives or the socket's receive timeout expires.
+    // Returns the number of datagrams (0 on timeout), or -1 on error.
+    int receive() { return receive(sock_, true); }
+
+    // With `wait` false, returns 0 right away if nothing is queued on `sock`.
+    int receive(SocketType sock, bool wait) {
+        if (buffers_.empty()) {
+            return -1;
+        }
+#ifdef _WIN32
+        Datagram& d = datagrams_[0];
+        int from_len = sizeof(d.from);
+        int received = recvfrom(sock, buffers_[0], static_cast<int>(pool_.buffer_size()), 0, (struct sockaddr*)&d.from, &from_len);
+        if (received == SOCKET_ERROR_CODE) {
+            int error = WSAGetLastError();
+            if (error == WSAETIMEDOUT || error == WSAEWOULDBLOCK) {
+                return 0;
+            }
+            if (error != WSAEMSGSIZE) {
+                return -1;
+            }
+            received = static_cast<int>(pool_.buffer_size());
+            d.truncated = true;
+        } else {
+            d.truncated = false;
+        }
+        d.data = buffers_[0];
+        d.size = static_cast<size_t>(received);
+        return 1;
+#else
+        for (size_t i = 0; i < buffers_.size(); ++i) {
+            iovecs_[i].iov_base = buffers_[i];
+            iovecs_[i].iov_len = pool_.buffer_size();
+            msgs_[i] = {};
+            msgs_[i].msg_hdr.msg_name = &datagrams_[i].from;
+            msgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            msgs_[i].msg_hdr.msg_iov = &iovecs_[i];
+            msgs_[i].msg_hdr.msg_iovlen = 1;
+        }
+        int count = recvmmsg(sock, msgs_.data(), static_cast<unsigned int>(msgs_.size()), wait ? MSG_WAITFORONE : MSG_DONTWAIT, nullptr);
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return 0;
+        }
+        for (int i = 0; i < count; ++i) {
+            datagrams_[i].data = buffers_[i];
+            datagrams_[i].size = msgs_[i].msg_len;
+            datagrams_[i].truncated = (msgs_[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+        }
+        return count;
+#endif
+    }
+
+    const Datagram& operator[](size_t i) const { return datagrams_[i]; }
+
+private:
+    SocketType sock_ = INVALID_SOCK;
+    BufferPool& pool_;
+    std::vector<char*> buffers_;
+    std::vector<Datagram> datagrams_;
+#ifndef _WIN32
+    std::vector<mmsghdr> msgs_;
+    std::vector<iovec> iovecs_;
+#endif
+};
+
+}  // namespace util
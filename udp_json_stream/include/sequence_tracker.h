@@ -0,0 +1,98 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+
+#include "histogram.h"
+
+namespace util {
+
+/**
+ * @brief Loss, reordering and one-way latency of one sender, from a sequence number and a send time.
+ *
+ * The last `window` sequence numbers are remembered, so a late message can be told apart from a
+ * duplicate and taken back off the loss count. A jump back by more than the window is taken as a
+ * sender restart.
+ */
+class SequenceTracker {
+public:
+    static constexpr uint64_t window = 1024;
+
+    void track_sequence(uint64_t seq) {
+        ++received_;
+        if (!started_) {
+            started_ = true;
+            first_ = max_ = seq;
+            seen_.set(seq % window);
+            return;
+        }
+
+        if (seq > max_) {
+            uint64_t gap = seq - max_ - 1;
+            lost_ += gap;
+            // forget the slots that now fall out of the window
+            for (uint64_t s = max_ + 1; s <= seq && s - max_ <= window; ++s) {
+                seen_.reset(s % window);
+            }
+            max_ = seq;
+            seen_.set(seq % window);
+        } else if (max_ - seq >= window) {
+            ++restarts_;
+            seen_.reset();
+            first_ = max_ = seq;
+            seen_.set(seq % window);
+        } else if (seen_.test(seq % window)) {
+            ++duplicates_;
+        } else if (seq < first_) {
+            // sent before the first one we saw, never counted as lost
+            first_ = seq;
+            seen_.set(seq % window);
+            ++reordered_;
+            reorder_depth_.record(max_ - seq);
+        } else {
+            // counted as lost when the gap opened
+            seen_.set(seq % window);
+            --lost_;
+            ++reordered_;
+            reorder_depth_.record(max_ - seq);
+        }
+    }
+
+    // `latency_us` is arrival time minus send time; negative values mean the clocks disagree.
+    void track_latency(int64_t latency_us) {
+        if (latency_us < 0) {
+            ++negative_latency_;
+            return;
+        }
+        latency_.record(static_cast<uint64_t>(latency_us));
+    }
+
+    uint64_t received() const { return received_; }
+    uint64_t lost() const { return lost_; }
+    uint64_t reordered() const { return reordered_; }
+    uint64_t duplicates() const { return duplicates_; }
+    uint64_t restarts() const { return restarts_; }
+    uint64_t negative_latency() const { return negative_latency_; }
+    double loss_percent() const {
+        uint64_t expected = received_ - duplicates_ + lost_;
+        return expected ? 100.0 * lost_ / expected : 0.0;
+    }
+    const Histogram& reorder_depth() const { return reorder_depth_; }
+    const Histogram& latency() const { return latency_; }
+
+private:
+    bool started_ = false;
+    uint64_t first_ = 0;
+    uint64_t max_ = 0;
+    std::bitset<window> seen_;
+    uint64_t received_ = 0;
+    uint64_t lost_ = 0;
+    uint64_t reordered_ = 0;
+    uint64_t duplicates_ = 0;
+    uint64_t restarts_ = 0;
+    uint64_t negative_latency_ = 0;
+    Histogram reorder_depth_;
+    Histogram latency_;
+};
+
+}  // namespace util
@@ -0,0 +1,48 @@
+#pragma once
+
+#ifdef _WIN32
+    #include <WinSock2.h>
+    #include <WS2tcpip.h>
+    #pragma comment(lib, "Ws2_32.lib")
+
+    typedef SOCKET SocketType;
+    #define INVALID_SOCK INVALID_SOCKET
+    #define CLOSE_SOCKET closesocket
+    #define SOCKET_ERROR_CODE SOCKET_ERROR
+#else // _WIN32, UNIX-like system: i.e. Linux
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+
+    typedef int SocketType;
+    #define INVALID_SOCK -1
+    #define CLOSE_SOCKET close
+    #define SOCKET_ERROR_CODE -1
+#endif
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <cerrno>
+#endif
+
+// Makes calls on `sock` fail with would_block() instead of waiting.
+inline bool set_nonblocking(SocketType sock) {
+#ifdef _WIN32
+    u_long on = 1;
+    return ioctlsocket(sock, FIONBIO, &on) == 0;
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    return flags >= 0 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+// Whether the last failed call on a non-blocking socket only found nothing to do.
+inline bool would_block() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
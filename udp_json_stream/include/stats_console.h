@@ -0,0 +1,102 @@
+#pragma once
+
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+#include "payload.h"
+#include "feed.h"
+#include "writer_pool.h"
+
+namespace util {
+
+/**
+ * @brief Periodic one-line-per-feed status: message rate, bytes/s, errors, writer queue and latest message.
+ *
+ * Meant to be printed about once a second from the thread that feeds the listeners (see
+ * EventLoop::every), so it costs the same at 10 or 100000 messages per second. The listeners must
+ * have `keep_latest` set to show their latest message, which is the first one received since the
+ * previous print: each print asks for the next one (Feed::sample_latest).
+ */
+class StatsConsole {
+public:
+    explicit StatsConsole(const WriterPool* writers = nullptr, size_t latest_width = 80)
+        : writers_(writers), latest_width_(latest_width), last_time_(std::chrono::steady_clock::now()) {}
+
+    void add(Feed& listener) { feeds_.push_back(FeedStatus{&listener, ReceiveStats{}}); }
+
+    void print(std::ostream& out = std::cout) {
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - last_time_).count();
+        last_time_ = now;
+
+        std::time_t wall = std::time(nullptr);
+        std::tm tm;
+#ifdef _WIN32
+        localtime_s(&tm, &wall);
+#else
+        localtime_r(&wall, &tm);
+#endif
+        // formatted on its own stream, so that `out` keeps its flags and prints the block at once
+        std::ostringstream text;
+        text << "[" << std::put_time(&tm, "%H:%M:%S") << "] " << feeds_.size() << " feed(s)";
+        if (writers_) {
+            text << ", writer queue " << writers_->queued() << ", dropped " << writers_->dropped();
+        }
+        text << "\n";
+
+        for (FeedStatus& feed : feeds_) {
+            const ReceiveStats& stats = feed.listener->stats();
+            double rate = seconds > 0 ? (stats.datagrams - feed.last.datagrams) / seconds : 0.0;
+            double kbytes = seconds > 0 ? (stats.bytes - feed.last.bytes) / seconds / 1024.0 : 0.0;
+            feed.last = stats;
+
+            text << "  " << std::left << std::setw(21) << feed.listener->name() << std::right
+                << std::fixed << std::setprecision(0) << std::setw(8) << rate << " msg/s"
+                << std::setprecision(1) << std::setw(9) << kbytes << " KB/s"
+                << "  sources " << feed.listener->sources().size()
+                << "  malformed " << stats.malformed
+                << "  truncated " << stats.truncated;
+            if (!feed.listener->latest().empty()) {
+                text << "  " << latest(*feed.listener);
+            }
+            feed.listener->sample_latest();
+            text << "\n";
+        }
+        out << text.str() << std::flush;
+    }
+
+private:
+    struct FeedStatus {
+        Feed* listener;
+        ReceiveStats last;  // at the previous print
+    };
+
+    // The latest message of a feed as compact json, cut to `latest_width_` characters.
+    std::string latest(const Feed& listener) const {
+        std::string text;
+        try {
+            const std::string& payload = listener.latest();
+            text = decode_payload(payload.data(), payload.size(), listener.latest_encoding()).dump();
+        } catch (nlohmann::json::exception&) {
+            return "(invalid)";
+        }
+        if (text.size() > latest_width_) {
+            text.resize(latest_width_ - 3);
+            text += "...";
+        }
+        return text;
+    }
+
+    const WriterPool* writers_;
+    size_t latest_width_;
+    std::vector<FeedStatus> feeds_;
+    std::chrono::steady_clock::time_point last_time_;
+};
+
+}  // namespace util
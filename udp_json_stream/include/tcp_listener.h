@@ -0,0 +1,293 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "socket.h"
+#include "byte_ring.h"
+#include "event_loop.h"
+#include "feed.h"
+#include "receiver.h"
+
+namespace util {
+
+// How messages are delimited on a TCP stream.
+enum class Framing {
+    newline,  // one message per line (NDJSON); empty lines are skipped
+    length    // each message preceded by its length, 4 bytes big endian
+};
+
+inline const char* framing_name(Framing framing) {
+    return framing == Framing::newline ? "newline" : "length";
+}
+
+/**
+ * @brief Accepts TCP connections on one port and logs the json/cbor/msgpack messages they carry.
+ *
+ * Sockets are non-blocking and served by an EventLoop. Each connection reads into its own ByteRing
+ * and is cut into messages as bytes arrive, so a message may span many reads and a read may hold
+ * many messages. Every connection is a sender of its own, like a UDP source address.
+ *
+ * Messages larger than `max_message` are counted as truncated and skipped. Messages are never
+ * dropped: a connection whose messages are waiting for the writers (`max_pending`) is not read
+ * until they catch up, and no connection is read while the writers' queue is half full, so TCP
+ * flow control slows the senders down instead.
+ */
+class TcpListener : public Feed {
+public:
+    TcpListener(const ListenerOptions& options, const std::string& csv_filename, Framing framing, size_t max_message = 1 << 20,
+                size_t max_connections = 1024, int64_t max_pending = 4096)
+        : Feed(options, csv_filename), framing_(framing), max_message_(max_message),
+          max_connections_(max_connections), max_pending_(max_pending) {
+        reliable_ = true;
+    }
+
+    ~TcpListener() override {
+        for (auto& entry : connections_) {
+            CLOSE_SOCKET(entry.first);
+        }
+        if (sock_ != INVALID_SOCK) {
+            CLOSE_SOCKET(sock_);
+        }
+    }
+
+    bool listen(const std::string& ip, int port) {
+        name_ = "tcp " + ip + ":" + std::to_string(port);
+        sock_ = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (sock_ == INVALID_SOCK) {
+            std::cerr << "Failed to create socket\n";
+            return false;
+        }
+#ifndef _WIN32
+        // restart without waiting for the previous run's connections to time out
+        int on = 1;
+        setsockopt(sock_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#endif
+
+        sockaddr_in server_addr;
+        memset(&server_addr, 0, sizeof(server_addr));
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_port = htons(port);
+        inet_pton(AF_INET, ip.c_str(), &server_addr.sin_addr);
+
+        if (::bind(sock_, (struct sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR_CODE
+            || ::listen(sock_, SOMAXCONN) == SOCKET_ERROR_CODE || !set_nonblocking(sock_)) {
+            std::cerr << "Listen failed on " << name_ << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Serves the port from `loop`, which must not outlive the listener.
+    bool start(EventLoop& loop) {
+        loop_ = &loop;
+        // paused connections are looked at again this often
+        loop.every(std::chrono::milliseconds(10), [this]() { resume(); });
+        return loop.watch(sock_, name_, [this]() { accept_all(); });
+    }
+
+    size_t connections() const { return connections_.size(); }
+    uint64_t accepted() const { return accepted_; }
+
+private:
+    struct Connection {
+        Connection(SocketType sock, const sockaddr_in& peer, size_t max_message)
+            : sock(sock), peer(peer), ring(4096, max_message + 5), pending(std::make_shared<std::atomic<int64_t>>(0)) {}
+
+        SocketType sock;
+        sockaddr_in peer;
+        ByteRing ring;
+        Pending pending;      // messages handed to the writers and not written yet
+        bool paused = false;
+        bool skipping = false;  // inside an oversized line, up to its newline
+        size_t skip = 0;        // bytes of an oversized length-prefixed message still to come
+    };
+
+    void accept_all() {
+        while (true) {
+            sockaddr_in peer;
+#ifdef _WIN32
+            int length = sizeof(peer);
+#else
+            socklen_t length = sizeof(peer);
+#endif
+            SocketType sock = ::accept(sock_, (struct sockaddr*)&peer, &length);
+            if (sock == INVALID_SOCK) {
+                if (!would_block()) {
+                    std::cerr << "Failed to accept on " << name_ << "\n";
+                }
+                return;
+            }
+            if (connections_.size() >= max_connections_ || !set_nonblocking(sock)) {
+                std::cerr << "Refusing connection on " << name_ << ", " << connections_.size() << " open\n";
+                CLOSE_SOCKET(sock);
+                continue;
+            }
+            auto connection = std::make_unique<Connection>(sock, peer, max_message_);
+            Connection* c = connection.get();
+            if (!loop_->watch(sock, name_, [this, c]() { read(*c); })) {
+                CLOSE_SOCKET(sock);
+                continue;
+            }
+            connections_.emplace(sock, std::move(connection));
+            ++accepted_;
+            if (options_.verbose) {
+                char ip[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &peer.sin_addr, ip, INET_ADDRSTRLEN);
+                std::cout << "Connection from " << ip << ":" << ntohs(peer.sin_port) << " on " << name_ << "\n";
+            }
+        }
+    }
+
+    // One read per wakeup, so that one busy connection cannot starve the others.
+    void read(Connection& c) {
+        if (c.pending->load(std::memory_order_relaxed) >= max_pending_ || writers_busy()) {
+            c.paused = true;
+            loop_->pause(c.sock, true);
+            return;
+        }
+        auto span = c.ring.write_span();
+        int received = recv(c.sock, span.first, static_cast<int>(std::min<size_t>(span.second, INT32_MAX)), 0);
+        if (received == SOCKET_ERROR_CODE && would_block()) {
+            return;
+        }
+        if (received <= 0) {
+            // closed by the peer (or reset): a last line without its newline still counts
+            split(c, true);
+            disconnect(c);
+            return;
+        }
+        c.ring.commit(static_cast<size_t>(received));
+        split(c, false);
+    }
+
+    // Cuts the complete messages off the front of the ring and hands them to the feed.
+    void split(Connection& c, bool at_end) {
+        ByteRing& ring = c.ring;
+        const size_t max_message = max_message_;
+        size_t offset = 0;
+        messages_.clear();
+        while (offset < ring.size()) {
+            size_t available = ring.size() - offset;
+            if (framing_ == Framing::newline) {
+                size_t end = ring.find('\n', offset);
+                if (c.skipping) {
+                    offset = end == ByteRing::npos ? ring.size() : end + 1;
+                    c.skipping = end == ByteRing::npos;
+                    continue;
+                }
+                if (end == ByteRing::npos) {
+                    if (available > max_message) {
+                        messages_.push_back(Datagram{nullptr, available, true, c.peer});
+                        c.skipping = true;
+                        offset = ring.size();
+                    } else if (at_end) {
+                        add_message(c, offset, available);
+                        offset = ring.size();
+                    }
+                    break;
+                }
+                if (end - offset > max_message) {
+                    messages_.push_back(Datagram{nullptr, end - offset, true, c.peer});
+                } else {
+                    add_message(c, offset, end - offset);
+                }
+                offset = end + 1;
+            } else {
+                if (c.skip > 0) {
+                    size_t skipped = std::min(c.skip, available);
+                    c.skip -= skipped;
+                    offset += skipped;
+                    continue;
+                }
+                if (available < 4) {
+                    break;
+                }
+                size_t length = 0;
+                for (size_t i = 0; i < 4; ++i) {
+                    length = (length << 8) | static_cast<uint8_t>(ring.at(offset + i));
+                }
+                if (length > max_message) {
+                    messages_.push_back(Datagram{nullptr, length, true, c.peer});
+                    c.skip = length;
+                    offset += 4;
+                    continue;
+                }
+                if (available - 4 < length) {
+                    break;
+                }
+                if (length > 0) {
+                    messages_.push_back(Datagram{ring.contiguous(offset + 4, length, wrapped_), length, false, c.peer});
+                }
+                offset += 4 + length;
+            }
+        }
+
+        if (!messages_.empty()) {
+            auto arrival_time = std::chrono::steady_clock::now();
+            int64_t arrival_epoch_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            process(messages_, static_cast<int>(messages_.size()), arrival_time, arrival_epoch_us, c.pending);
+        }
+        ring.consume(offset);
+    }
+
+    // Adds the line at [offset, offset + length) unless it is empty; a trailing '\r' is dropped.
+    void add_message(Connection& c, size_t offset, size_t length) {
+        const char* data = c.ring.contiguous(offset, length, wrapped_);
+        if (length > 0 && data[length - 1] == '\r') {
+            --length;
+        }
+        if (length > 0) {
+            messages_.push_back(Datagram{data, length, false, c.peer});
+        }
+    }
+
+    void disconnect(Connection& c) {
+        SocketType sock = c.sock;
+        if (options_.verbose) {
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &c.peer.sin_addr, ip, INET_ADDRSTRLEN);
+            std::cout << "Connection from " << ip << ":" << ntohs(c.peer.sin_port) << " closed\n";
+        }
+        loop_->unwatch(sock);
+        CLOSE_SOCKET(sock);
+        // a connection is a sender of its own: a reconnecting client gets new files
+        retire_source(c.peer);
+        connections_.erase(sock);
+    }
+
+    // Reads again from connections whose writers have caught up.
+    void resume() {
+        if (writers_busy()) {
+            return;
+        }
+        for (auto& entry : connections_) {
+            Connection& c = *entry.second;
+            if (c.paused && c.pending->load(std::memory_order_relaxed) <= max_pending_ / 2) {
+                c.paused = false;
+                loop_->pause(c.sock, false);
+            }
+        }
+    }
+
+    Framing framing_;
+    size_t max_message_;
+    size_t max_connections_;
+    int64_t max_pending_;
+    SocketType sock_ = INVALID_SOCK;
+    EventLoop* loop_ = nullptr;
+    std::unordered_map<SocketType, std::unique_ptr<Connection>> connections_;
+    uint64_t accepted_ = 0;
+    std::vector<Datagram> messages_;  // of the current read
+    std::vector<char> wrapped_;       // the one message of a read that may wrap around its ring
+};
+
+}  // namespace util
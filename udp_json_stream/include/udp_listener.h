@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "socket.h"
+#include "receiver.h"
+#include "feed.h"
+
+namespace util {
+
+/**
+ * @brief Receives json/cbor/msgpack datagrams on one UDP port and logs them to csv, per sender.
+ *
+ * Either runs its own receive loop (run), or is fed by an EventLoop serving many ports.
+ */
+class UdpListener : public Feed {
+public:
+    UdpListener(const ListenerOptions& options, const std::string& csv_filename)
+        : Feed(options, csv_filename) {}
+
+    ~UdpListener() override {
+        if (sock_ != INVALID_SOCK) {
+            CLOSE_SOCKET(sock_);
+        }
+    }
+
+    bool bind(const std::string& ip, int port) {
+        return open(ip, port, false);
+    }
+
+    // Receives the multicast `group` on `port`, through the interface with address `interface_ip`
+    // (any if empty). Several listeners may join groups on the same port.
+    bool join(const std::string& group, int port, const std::string& interface_ip = "") {
+        ip_mreq request;
+        memset(&request, 0, sizeof(request));
+        if (inet_pton(AF_INET, group.c_str(), &request.imr_multiaddr) != 1
+            || (!interface_ip.empty() && inet_pton(AF_INET, interface_ip.c_str(), &request.imr_interface) != 1)) {
+            std::cerr << "Invalid multicast address " << group << (interface_ip.empty() ? "" : " @ " + interface_ip) << "\n";
+            return false;
+        }
+        // Linux filters by the bound address, Windows only accepts binding to any
+#ifdef _WIN32
+        if (!open("0.0.0.0", port, true)) {
+#else
+        if (!open(group, port, true)) {
+#endif
+            return false;
+        }
+        if (setsockopt(sock_, IPPROTO_IP, IP_ADD_MEMBERSHIP, reinterpret_cast<const char*>(&request), sizeof(request)) == SOCKET_ERROR_CODE) {
+            std::cerr << "Failed to join multicast group " << group << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Receives and logs datagrams until `running` is cleared.
+    void run(const std::atomic<bool>& running) {
+        // batch * buffer_size bytes in total, reused for every batch
+        BufferPool pool(options_.batch, options_.buffer_size);
+        DatagramReceiver receiver(sock_, pool, options_.batch);
+
+        while (running) {
+            int count = receiver.receive();
+
+            if (count == SOCKET_ERROR_CODE) {
+                std::cerr << "Failed to receive\n";
+                continue;
+            }
+
+            auto arrival_time = std::chrono::steady_clock::now();
+            int64_t arrival_epoch_us = 0;
+            if (!options_.time_field.empty()) {
+                arrival_epoch_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+            }
+            process(receiver, count, arrival_time, arrival_epoch_us);
+        }
+    }
+
+    SocketType socket() const { return sock_; }
+
+private:
+    bool open(const std::string& ip, int port, bool reuse_address) {
+        name_ = ip + ":" + std::to_string(port);
+        sock_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (sock_ == INVALID_SOCK) {
+            std::cerr << "Failed to create socket\n";
+            return false;
+        }
+        if (reuse_address) {
+            int on = 1;
+            setsockopt(sock_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof(on));
+        }
+
+        sockaddr_in server_addr;
+        memset(&server_addr, 0, sizeof(server_addr));
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_port = htons(port);
+
+#ifdef _WIN32
+        inet_pton(AF_INET, ip.c_str(), &server_addr.sin_addr);
+#else
+        server_addr.sin_addr.s_addr = inet_addr(ip.c_str());
+#endif
+
+        if (::bind(sock_, (struct sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR_CODE) {
+            std::cerr << "Bind failed on " << name_ << "\n";
+            return false;
+        }
+
+        // wake up regularly so that run() notices when it should stop
+#ifdef _WIN32
+        DWORD timeout = 100;
+        setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+#else
+        timeval timeout{0, 100000};
+        setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+        return true;
+    }
+
+    SocketType sock_ = INVALID_SOCK;
+};
+
+}  // namespace util
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace util {
+
+/**
+ * @brief A few threads shared by many feeds for flattening and writing their messages.
+ *
+ * Each feed is assigned to one worker, so its tasks run in order and its state is only touched by
+ * that worker. A worker takes all queued tasks at once and runs its flush callbacks after each such
+ * batch, so files are flushed once per burst rather than once per message. Queues are bounded:
+ * when a worker falls behind, post() drops the task and counts it instead of stalling the receiver.
+ * A receiver that can hold back (TCP) uses push(), which never drops, and stops reading while the
+ * worker is busy().
+ */
+class WriterPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WriterPool(size_t threads, size_t max_queue = 65536) : max_queue_(max_queue) {
+        for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+        for (auto& worker : workers_) {
+            worker->thread = std::thread([this, w = worker.get()]() { work(*w); });
+        }
+    }
+
+    ~WriterPool() { stop(); }
+
+    WriterPool(const WriterPool&) = delete;
+    WriterPool& operator=(const WriterPool&) = delete;
+
+    // Picks the worker for a new feed, round robin.
+    size_t assign() { return next_++ % workers_.size(); }
+
+    // Called by `worker` after each batch of tasks; register before posting.
+    void on_flush(size_t worker, Task flush) { workers_[worker]->flushes.push_back(std::move(flush)); }
+
+    // Returns false if the worker's queue is full and the task was dropped.
+    bool post(size_t worker, Task task) {
+        Worker& w = *workers_[worker];
+        {
+            std::lock_guard<std::mutex> lock(w.mutex);
+            if (w.queue.size() >= max_queue_) {
+                ++dropped_;
+                return false;
+            }
+            w.queue.push_back(std::move(task));
+        }
+        w.ready.notify_one();
+        return true;
+    }
+
+    // Like post(), but queues the task however long the queue is: for tasks that must run.
+    void push(size_t worker, Task task) {
+        Worker& w = *workers_[worker];
+        {
+            std::lock_guard<std::mutex> lock(w.mutex);
+            w.queue.push_back(std::move(task));
+        }
+        w.ready.notify_one();
+    }
+
+    // Runs every queued task, then joins the workers.
+    void stop() {
+        for (auto& worker : workers_) {
+            {
+                std::lock_guard<std::mutex> lock(worker->mutex);
+                worker->stopping = true;
+            }
+            worker->ready.notify_one();
+        }
+        for (auto& worker : workers_) {
+            if (worker->thread.joinable()) {
+                worker->thread.join();
+            }
+        }
+    }
+
+    // Half of the queue is taken: receivers that push() should stop reading until it is not.
+    bool busy(size_t worker) const {
+        const Worker& w = *workers_[worker];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        return w.queue.size() >= max_queue_ / 2;
+    }
+
+    size_t threads() const { return workers_.size(); }
+    uint64_t dropped() const { return dropped_; }
+
+    // Tasks waiting over all workers.
+    size_t queued() const {
+        size_t total = 0;
+        for (const auto& worker : workers_) {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            total += worker->queue.size();
+        }
+        return total;
+    }
+
+private:
+    struct Worker {
+        std::thread thread;
+        mutable std::mutex mutex;
+        std::condition_variable ready;
+        std::vector<Task> queue;
+        std::vector<Task> flushes;
+        bool stopping = false;
+    };
+
+    void work(Worker& w) {
+        std::vector<Task> tasks;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(w.mutex);
+                w.ready.wait(lock, [&]() { return w.stopping || !w.queue.empty(); });
+                if (w.queue.empty()) {
+                    return;
+                }
+                tasks.swap(w.queue);
+            }
+            for (auto& task : tasks) {
+                task();
+            }
+            tasks.clear();
+            for (auto& flush : w.flushes) {
+                flush();
+            }
+        }
+    }
+
+    size_t max_queue_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> next_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
+
+}  // namespace util
@@ -0,0 +1,128 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include <type_traits>
+
+#include "nlohmann/json.hpp"
+using json = nlohmann::json;
+
+#include "key_table.h"
+#include "payload.h"
+#include "arena.h"
+#include "json_reader.h"
+
+// Compares bytes on the wire and decode cost (decode + flatten) of json, cbor and msgpack payloads,
+// with the default allocator, with the listener's per-message arena, and (json only) flattened in place
+// without building a json value, as the listener does (heap allocations per message).
+
+static size_t g_allocations = 0;
+
+// Every replaceable form of new and delete goes through the same counted malloc/free pair.
+static void* counted_allocate(size_t size) {
+    ++g_allocations;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size) { return counted_allocate(size); }
+void* operator new[](size_t size) { return counted_allocate(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+json quuppa_message() {
+    return json{
+        {"tagId", "ac233fe35e33"},
+        {"tagName", "Nearth_0003"},
+        {"location", {5.13, 4.78, 1.2}},
+        {"locationTS", 1726028791854},
+        {"locationCoordSysId", "f5aa32a1-4b3c-4f55-8e46-cdbd1a3c3c62"},
+        {"locationZoneNames", {"Zone001"}},
+        {"locationMovementStatus", "moving"},
+        {"locationRadius", 0.42}
+    };
+}
+
+json sample_talker_message() {
+    return json{
+        {"message", "Hello, world!"},
+        {"number", 37},
+        {"timestamp", "2024-09-11_13:26:31"},
+        {"nested", {
+            {"nestedness", true},
+            {"data", {1, 2, 3, 4, 5}}
+        }}
+    };
+}
+
+json wide_message(int fields) {
+    json message;
+    for (int i = 0; i < fields; ++i) {
+        message["group" + std::to_string(i % 8)]["field" + std::to_string(i)] = 1000.0 / (i + 3);
+    }
+    message["tagId"] = "ac233fe35e33";
+    return message;
+}
+
+// Decodes and flattens `payload` `iterations` times; the scratch arena is reset before each message,
+// and holds the decoded message too with `use_arena`. Json is not a json type for the in-place reader.
+template <typename Json>
+void bench_decode(const std::vector<uint8_t>& payload, util::Encoding encoding, int iterations, bool use_arena) {
+    const char* data = reinterpret_cast<const char*>(payload.data());
+    util::KeyTable keys;
+    std::vector<util::Cell> row;
+    util::Arena scratch;
+    util::JsonRowReader reader;
+    size_t cells = 0;
+    size_t allocations = g_allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        scratch.reset();
+        util::ArenaScope scope(use_arena ? &scratch : nullptr);
+        std::fill(row.begin(), row.end(), util::Cell());
+        if constexpr (std::is_same_v<Json, util::JsonRowReader>) {
+            reader.read(data, payload.size(), keys, row, scratch);
+        } else {
+            Json decoded = util::decode_payload<Json>(data, payload.size(), util::detect_encoding(data, payload.size()));
+            util::flatten_json(decoded, keys, util::KeyTable::root, row, scratch);
+        }
+        cells += row.size();
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    allocations = g_allocations - allocations;
+
+    const char* mode = std::is_same_v<Json, util::JsonRowReader> ? "reader" : use_arena ? "arena" : "heap";
+    std::cout << "  " << std::setw(8) << std::left << util::encoding_name(encoding) << std::setw(7) << mode << std::right
+              << std::setw(8) << payload.size() << " bytes"
+              << std::setw(10) << std::fixed << std::setprecision(0) << elapsed / iterations << " ns/msg"
+              << std::setw(8) << std::setprecision(1) << static_cast<double>(allocations) / iterations << " allocs/msg"
+              << "  (" << cells / iterations << " columns)\n";
+}
+
+void bench(const std::string& name, const json& message, int iterations) {
+    std::cout << name << "\n";
+    for (util::Encoding encoding : {util::Encoding::json, util::Encoding::cbor, util::Encoding::msgpack}) {
+        std::vector<uint8_t> payload = util::encode_payload(message, encoding);
+        bench_decode<json>(payload, encoding, iterations, false);
+        bench_decode<util::arena_json>(payload, encoding, iterations, true);
+        if (encoding == util::Encoding::json) {
+            bench_decode<util::JsonRowReader>(payload, encoding, iterations, true);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 100000;
+
+    bench("quuppa location", quuppa_message(), iterations);
+    bench("sample talker", sample_talker_message(), iterations);
+    bench("wide (64 fields)", wide_message(64), iterations / 4);
+    return 0;
+}
@@ -0,0 +1,259 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ctime>
+
+#include "nlohmann/json.hpp"
+using json = nlohmann::json;
+
+#include "udp_listener.h"
+#include "event_loop.h"
+#include "writer_pool.h"
+#include "load_generator.h"
+
+// End-to-end benchmark of the UDP json path on loopback: a UdpListener, driven by an EventLoop and a
+// WriterPool as in the listener, and a LoadGenerator run in this process while the message rate and payload
+// size are swept. Each case reports the delivered rate, loss, CPU time per message of the receiving and the
+// writer threads and arrival-to-written latency percentiles; all cases are saved as json.
+
+double thread_cpu_seconds() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+    auto to_100ns = [](const FILETIME& t) { return (static_cast<uint64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime; };
+    return (to_100ns(kernel) + to_100ns(user)) * 1e-7;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+std::vector<double> parse_list(const std::string& text) {
+    std::vector<double> values;
+    std::stringstream ss(text);
+    for (std::string value; std::getline(ss, value, ',');) {
+        values.push_back(std::stod(value));
+    }
+    return values;
+}
+
+json quuppa_message() {
+    return json{
+        {"tagId", "ac233fe35e33"},
+        {"tagName", "Nearth_0003"},
+        {"location", {5.13, 4.78, 1.2}},
+        {"locationTS", 1726028791854}
+    };
+}
+
+// CPU time of every writer thread so far, read on the threads themselves.
+double writer_cpu_seconds(util::WriterPool& writers) {
+    std::vector<double> seconds(writers.threads());
+    std::atomic<size_t> done = 0;
+    for (size_t i = 0; i < writers.threads(); ++i) {
+        writers.push(i, [&seconds, &done, i]() {
+            seconds[i] = thread_cpu_seconds();
+            done.fetch_add(1);
+        });
+    }
+    while (done.load() < seconds.size()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    double total = 0;
+    for (double s : seconds) {
+        total += s;
+    }
+    return total;
+}
+
+json run_case(double rate, size_t payload_size, int port, double duration, size_t writer_threads, const util::LoadOptions& load, const std::filesystem::path& dir) {
+    std::filesystem::create_directories(dir);
+    util::ListenerOptions options;
+    options.record_latency = true;
+
+    util::UdpListener listener(options, (dir / "bench.csv").string());
+    util::EventLoop loop(options.batch, options.buffer_size);
+    if (!listener.bind("127.0.0.1", port) || !loop.add(listener)) {
+        return json();
+    }
+    // declared after the listener, so that it is stopped before the listener goes away
+    std::unique_ptr<util::WriterPool> writers;
+    double writer_start = 0;
+    if (writer_threads > 0) {
+        writers = std::make_unique<util::WriterPool>(writer_threads);
+        listener.set_writers(*writers);
+        writer_start = writer_cpu_seconds(*writers);
+    }
+
+    std::atomic<bool> running = true;
+    double cpu_seconds = 0;
+    std::thread listener_thread([&]() {
+        double start = thread_cpu_seconds();
+        loop.run(running);
+        cpu_seconds = thread_cpu_seconds() - start;
+    });
+
+    sockaddr_in target;
+    memset(&target, 0, sizeof(target));
+    target.sin_family = AF_INET;
+    target.sin_port = htons(port);
+    target.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    util::LoadOptions load_options = load;
+    load_options.rate = rate;
+    load_options.duration = duration;
+    std::vector<util::PayloadTemplate> templates{util::make_template(quuppa_message(), util::Encoding::json, "seq", "sentTimeUs", payload_size)};
+    const size_t bytes = templates.front().bytes.size();
+    {
+        util::LoadGenerator generator(target, std::move(templates), load_options);
+        generator.start();
+        generator.join();
+
+        // let the listener drain its socket buffer
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        running = false;
+        listener_thread.join();
+        double writer_seconds = 0;
+        uint64_t dropped = 0;
+        if (writers) {
+            writer_seconds = writer_cpu_seconds(*writers) - writer_start;
+            writers->stop();
+            dropped = writers->dropped();
+        }
+
+        const auto& stats = listener.stats();
+        const auto& latency = listener.latency();
+        const uint64_t sent = generator.sent();
+        const uint64_t received = stats.datagrams;
+        std::filesystem::remove_all(dir);
+
+        return json{
+            {"target_rate", rate},
+            {"payload_bytes", bytes},
+            {"duration_s", duration},
+            {"sent", sent},
+            {"received", received},
+            {"dropped", dropped},
+            {"delivered_rate", received / duration},
+            {"loss_pct", sent ? 100.0 * (sent - std::min(sent, received)) / sent : 0.0},
+            {"writers", writer_threads},
+            {"cpu_us_per_msg", received ? (cpu_seconds + writer_seconds) * 1e6 / received : 0.0},
+            {"writer_cpu_us_per_msg", received ? writer_seconds * 1e6 / received : 0.0},
+            {"latency_us", {
+                {"p50", latency.percentile(50)},
+                {"p90", latency.percentile(90)},
+                {"p99", latency.percentile(99)},
+                {"p999", latency.percentile(99.9)},
+                {"max", latency.max()}
+            }}
+        };
+    }
+}
+
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --rates <msg/s,...>     target rates, 0 for as fast as possible (default 1000,10000,50000,0)\n"
+              << "  --sizes <bytes,...>     payload sizes (default 128,1024,8192)\n"
+              << "  --duration <s>          send time per case (default 2)\n"
+              << "  --threads <n>           sender threads (default 1)\n"
+              << "  --batch <n>             messages per sendmmsg (default 16)\n"
+              << "  --writers <n>           writer threads, 0 to write on the receiving thread (default 1)\n"
+              << "  --port <port>           first loopback port (default 47000)\n"
+              << "  --output <file>         results as json (default bench_loopback.json)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<double> rates{1000, 10000, 50000, 0};
+    std::vector<double> sizes{128, 1024, 8192};
+    double duration = 2;
+    int port = 47000;
+    size_t writer_threads = 1;
+    std::string output = "bench_loopback.json";
+    util::LoadOptions load;
+    load.batch = 16;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--rates") {
+            rates = parse_list(value);
+        } else if (arg == "--sizes") {
+            sizes = parse_list(value);
+        } else if (arg == "--duration") {
+            duration = std::stod(value);
+        } else if (arg == "--threads") {
+            load.threads = std::max(std::stoi(value), 1);
+        } else if (arg == "--batch") {
+            load.batch = std::max<size_t>(std::stoul(value), 1);
+        } else if (arg == "--writers") {
+            writer_threads = std::stoul(value);
+        } else if (arg == "--port") {
+            port = std::stoi(value);
+        } else if (arg == "--output") {
+            output = value;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        std::cerr << "WSAStartup failed\n";
+        return 1;
+    }
+#endif
+
+    const auto dir = std::filesystem::temp_directory_path() / "udp_json_bench";
+    json cases = json::array();
+    std::cout << std::setw(10) << "rate" << std::setw(8) << "bytes" << std::setw(12) << "delivered" << std::setw(9) << "loss%" << std::setw(9) << "dropped"
+              << std::setw(10) << "cpu us" << std::setw(8) << "p50" << std::setw(8) << "p99" << std::setw(8) << "max" << std::endl;
+    for (double size : sizes) {
+        for (double rate : rates) {
+            json result = run_case(rate, static_cast<size_t>(size), port++, duration, writer_threads, load, dir);
+            if (result.is_null()) {
+                continue;
+            }
+            cases.push_back(result);
+            std::cout << std::setw(10) << (rate > 0 ? std::to_string(static_cast<long>(rate)) : "max")
+                      << std::setw(8) << result["payload_bytes"].get<size_t>()
+                      << std::setw(12) << std::fixed << std::setprecision(0) << result["delivered_rate"].get<double>()
+                      << std::setw(9) << std::setprecision(2) << result["loss_pct"].get<double>()
+                      << std::setw(9) << result["dropped"].get<uint64_t>()
+                      << std::setw(10) << std::setprecision(2) << result["cpu_us_per_msg"].get<double>()
+                      << std::setw(8) << result["latency_us"]["p50"].get<uint64_t>()
+                      << std::setw(8) << result["latency_us"]["p99"].get<uint64_t>()
+                      << std::setw(8) << result["latency_us"]["max"].get<uint64_t>() << std::endl;
+        }
+    }
+
+    json report{
+        {"benchmark", "udp_json_loopback"},
+        {"time", static_cast<int64_t>(std::time(nullptr))},
+        {"threads", load.threads},
+        {"batch", load.batch},
+        {"writers", writer_threads},
+        {"cases", cases}
+    };
+    std::ofstream(output) << report.dump(2) << std::endl;
+    std::cout << "Results written to " << output << std::endl;
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+using json = nlohmann::json;
+
+#include "key_table.h"
+#include "payload.h"
+#include "projection.h"
+
+// Compares decoding every field of wide messages against decoding only a few projected json pointers.
+
+json wide_message(int fields) {
+    json message{
+        {"tagId", "ac233fe35e33"},
+        {"location", {5.13, 4.78, 1.2}},
+        {"locationTS", 1726028791854}
+    };
+    for (int i = 0; i < fields; ++i) {
+        json& group = message["diagnostics"]["group" + std::to_string(i % 16)];
+        group["value" + std::to_string(i)] = 1000.0 / (i + 3);
+        group["label" + std::to_string(i)] = "sensor reading number " + std::to_string(i);
+        group["history" + std::to_string(i)] = {i, i + 1, i + 2, i + 3};
+    }
+    return message;
+}
+
+double run(const std::vector<uint8_t>& payload, const util::Projection* projection, int iterations, size_t& columns) {
+    const char* data = reinterpret_cast<const char*>(payload.data());
+    util::KeyTable keys;
+    std::vector<util::Cell> row;
+    util::Arena scratch;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        util::Encoding encoding = util::detect_encoding(data, payload.size());
+        json decoded = projection ? util::decode_projected(data, payload.size(), encoding, *projection)
+                                  : util::decode_payload(data, payload.size(), encoding);
+        scratch.reset();
+        std::fill(row.begin(), row.end(), util::Cell());
+        util::flatten_json(decoded, keys, util::KeyTable::root, row, scratch);
+    }
+    columns = keys.size();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 2000;
+    util::Projection projection({"/tagId", "/location", "/locationTS", "/diagnostics/group3/value3"});
+
+    for (int fields : {16, 64, 256}) {
+        json message = wide_message(fields);
+        for (util::Encoding encoding : {util::Encoding::json, util::Encoding::cbor}) {
+            std::vector<uint8_t> payload = util::encode_payload(message, encoding);
+            size_t full_columns = 0, projected_columns = 0;
+            double full = run(payload, nullptr, iterations, full_columns);
+            double projected = run(payload, &projection, iterations, projected_columns);
+            std::cout << std::setw(4) << fields << " fields " << std::setw(8) << std::left << util::encoding_name(encoding) << std::right
+                      << std::setw(7) << payload.size() << " bytes"
+                      << "  full " << std::setw(9) << std::fixed << std::setprecision(0) << full << " ns (" << full_columns << " columns)"
+                      << "  projected " << std::setw(8) << projected << " ns (" << projected_columns << " columns)"
+                      << "  x" << std::setprecision(1) << full / projected << std::endl;
+        }
+    }
+    return 0;
+}
@@ -6,32 +6,23 @@
 #include <cstring>
 #include <chrono>
 #include <vector>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <csignal>
 
-#ifdef _WIN32
-    #include <WinSock2.h>
-    #include <WS2tcpip.h>
-    #pragma comment(lib, "Ws2_32.lib")
-
-    typedef SOCKET SocketType;
-    #define INVALID_SOCK INVALID_SOCKET
-    #define CLOSE_SOCKET closesocket
-    #define SOCKET_ERROR_CODE SOCKET_ERROR
-#else // _WIN32, UNIX-like system: i.e. Linux
-    #include <sys/socket.h>
-    #include <netinet/in.h>
-    #include <arpa/inet.h>
-    #include <sys/stat.h>
-    #include <unistd.h>
-
-    typedef int SocketType;
-    #define INVALID_SOCK -1
-    #define CLOSE_SOCKET close
-    #define SOCKET_ERROR_CODE -1
-#endif
+#include "socket.h"
 
 #include "nlohmann/json.hpp"
 using json = nlohmann::json;
 
+#include "udp_listener.h"
+#include "tcp_listener.h"
+#include "event_loop.h"
+#include "writer_pool.h"
+#include "stats_console.h"
+
 #define VERBOSE
 // #undef VERBOSE
 std::string get_current_timestamp_filename(const std::string &relative_base_dir="") {
@@ -62,53 +53,51 @@ std::string get_current_timestamp_filename(const std::string &relative_base_dir=
     return full_path.string();
 }
 
-void flatten_json(const json& j, std::string prefix, json& result) {
-    for (auto& el : j.items()) {
-        // concatenate the key with the parent structure key using dot
-        std::string new_key = prefix.empty() ? el.key() : prefix + "." + el.key();
-        if (el.value().is_object()) {
-            flatten_json(el.value(), new_key, result);
-        } else {
-            result[new_key] = el.value();
-        }
-    }
+std::atomic<bool> g_running = true;
+
+void signal_handler(int) {
+    g_running = false;
 }
 
-std::string escape_csv(const std::string& str) {
-    std::ostringstream oss;
-    oss << '"';
-    for (auto c : str) {
-        if (c == '"') {
-            oss << '"' << '"';
-        } else {
-            oss << c;
-        }
+// A port to listen on, or a multicast group to join.
+struct Binding {
+    std::string ip;
+    int port = 0;
+    bool multicast = false;
+    std::string interface_ip = "";  // for multicast, empty for any
+    bool tcp = false;
+};
+
+// Parses "<ip>:<port>" or, for multicast, "<group>:<port>[@<interface ip>]".
+bool parse_binding(const std::string& spec, bool multicast, Binding& binding) {
+    size_t at = multicast ? spec.find('@') : std::string::npos;
+    std::string address = spec.substr(0, at);
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
     }
-    oss << '"';
-    return oss.str();
+    binding.ip = address.substr(0, colon);
+    binding.port = std::stoi(address.substr(colon + 1));
+    binding.multicast = multicast;
+    binding.interface_ip = at == std::string::npos ? "" : spec.substr(at + 1);
+    return true;
 }
 
-void write_csv_line(std::ofstream& file, const json& j, const std::vector<std::string>& keys) {
-    for (size_t i = 0; i < keys.size(); ++i) {
-        if (j.contains(keys[i])) {
-            const auto& value = j[keys[i]];
-            if (value.is_string()) {
-                file << escape_csv(value.get<std::string>());
-            } else if (value.is_number() || value.is_boolean()) {
-                file << value;
-            } else {
-                file << escape_csv(value.dump());
-            }
-        } else {
-            // Write an empty string if the key is not found
-            file << "";
+void print_summary(const util::Feed& listener, const util::ListenerOptions& options) {
+    const util::ReceiveStats& stats = listener.stats();
+    const auto* tcp = dynamic_cast<const util::TcpListener*>(&listener);
+    std::cout << listener.name() << ": received " << stats.datagrams << (tcp ? " messages (" : " datagrams (") << stats.bytes << " bytes) from "
+              << (tcp ? tcp->accepted() : listener.sources().size()) << (tcp ? " connection(s)" : " source(s)") << ", truncated: " << stats.truncated
+              << ", malformed: " << stats.malformed << std::endl;
+    if (!options.seq_field.empty() || !options.time_field.empty()) {
+        for (const auto& entry : listener.sources()) {
+            util::print_tracker(entry.second);
         }
-        if (i < keys.size() - 1) file << ",";
     }
-    file << "\n";
 }
 
-void udp_listener(const std::string& ip, int port) {
+void udp_listener(const std::vector<Binding>& bindings, const util::ListenerOptions& options, util::Framing framing, size_t max_message,
+                  size_t writer_threads, double status_seconds) {
 #ifdef _WIN32
     WSADATA wsaData;
     if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
@@ -117,121 +106,203 @@ void udp_listener(const std::string& ip, int port) {
     }
 #endif
 
-    SocketType sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock == INVALID_SOCK) {
-        std::cerr << "Failed to create socket\n";
-#ifdef _WIN32
-        WSACleanup();
-#endif
-        return;
-    }
-
-    sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
-
-#ifdef _WIN32
-    inet_pton(AF_INET, ip.c_str(), &server_addr.sin_addr);
-#else
-    server_addr.sin_addr.s_addr = inet_addr(ip.c_str());
-#endif
-
-    if (bind(sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR_CODE) {
-        std::cerr << "Bind failed\n";
-        CLOSE_SOCKET(sock);
-#ifdef _WIN32
-        WSACleanup();
-#endif
-        return;
-    }
-
     std::string csv_filename = get_current_timestamp_filename("../../../logs/json_udp");
+    {
+        std::vector<std::unique_ptr<util::Feed>> listeners;
+        util::EventLoop loop(options.batch, options.buffer_size);
+        // declared after the listeners, so that it is stopped before they go away
+        std::unique_ptr<util::WriterPool> writers;
+        if (writer_threads > 0) {
+            writers = std::make_unique<util::WriterPool>(writer_threads);
+        }
+        for (const Binding& binding : bindings) {
+            // one binding keeps the plain <time>.csv name, several get <time>_[tcp-]<ip>-<port>.csv
+            std::filesystem::path path = csv_filename;
+            if (bindings.size() > 1) {
+                path.replace_filename(path.stem().string() + "_" + (binding.tcp ? "tcp-" : "") + binding.ip + "-" + std::to_string(binding.port) + path.extension().string());
+            }
+            std::unique_ptr<util::Feed> listener;
+            if (binding.tcp) {
+                auto tcp = std::make_unique<util::TcpListener>(options, path.string(), framing, max_message);
+                if (!tcp->listen(binding.ip, binding.port) || !tcp->start(loop)) {
+                    return;
+                }
+                listener = std::move(tcp);
+            } else {
+                auto udp = std::make_unique<util::UdpListener>(options, path.string());
+                bool bound = binding.multicast ? udp->join(binding.ip, binding.port, binding.interface_ip)
+                                               : udp->bind(binding.ip, binding.port);
+                if (!bound || !loop.add(*udp)) {
+                    return;
+                }
+                listener = std::move(udp);
+            }
+            if (writers) {
+                listener->set_writers(*writers);
+            }
 #ifdef VERBOSE
-    std::cout << "Starting UDP listener on " << ip << " port " << port << "\n";
-    std::cout << "CSV filename: " << csv_filename << std::endl;
-#endif
-
-    std::ofstream csv_file(csv_filename);
-    if (!csv_file.is_open()) {
-        std::cerr << "Failed to open " << csv_filename << "\n";
-        CLOSE_SOCKET(sock);
-#ifdef _WIN32
-        WSACleanup();
-#endif
-        return;
-    }
-
-    char buffer[4096];
-    sockaddr_in client_addr;
-#ifdef _WIN32
-    int client_len = sizeof(client_addr);
-#else
-    socklen_t client_len = sizeof(client_addr);
+            if (binding.tcp) {
+                std::cout << "Starting TCP listener (" << util::framing_name(framing) << " framing) on " << binding.ip << " port " << binding.port << "\n";
+            } else {
+                std::cout << "Starting UDP listener on " << (binding.multicast ? "multicast group " : "") << binding.ip << " port " << binding.port << "\n";
+            }
+            if (options.merge_sources) {
+                std::cout << "CSV filename: " << path.string() << std::endl;
+            } else {
+                std::cout << "CSV filenames: " << (path.parent_path() / (path.stem().string() + "_<ip>-<port>" + path.extension().string())).string()
+                          << ", one per sender" << std::endl;
+            }
 #endif
-
-    std::vector<std::string> header;
-    bool header_written = false;
-
-    while (true) {
-        int received = recvfrom(sock, buffer, sizeof(buffer), 0, (struct sockaddr*)&client_addr, &client_len);
-
-        if (received == SOCKET_ERROR_CODE) {
-            std::cerr << "Failed to receive\n";
-            continue;
+            listeners.push_back(std::move(listener));
         }
 
-        auto arrivalTime = std::chrono::steady_clock::now();
-        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(arrivalTime.time_since_epoch()).count();
-        char client_ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-        try {
-            json message = json::parse(std::string(buffer, received));
-#ifdef VERBOSE
-            std::cout << "Received JSON message:\n" << message.dump(2) << "\n";
-#endif
-            json flattened;
-            flatten_json(message, "", flattened);
-            // manual time tag
-            flattened["ArrivalTimeUs"] = micros;
-
-            if (!header_written) {
-                for (auto& item : flattened.items()) {
-                    header.push_back(item.key());
-                }
-                for (size_t i = 0; i < header.size(); i++) {
-                    csv_file << escape_csv(header[i]);
-                    if (i < header.size() - 1) {
-                        csv_file << ",";
-                    }
-                }
-                csv_file << "\n";
-                header_written = true;
+        util::StatsConsole console(writers.get());
+        if (status_seconds > 0) {
+            for (const auto& listener : listeners) {
+                console.add(*listener);
             }
+            loop.every(std::chrono::milliseconds(static_cast<int64_t>(status_seconds * 1000)), [&console]() { console.print(); });
+        }
+
+        loop.run(g_running);
 
-            write_csv_line(csv_file, flattened, header);
-            csv_file.flush();
+        if (writers) {
+            writers->stop();
+            if (writers->dropped()) {
+                std::cout << "Dropped " << writers->dropped() << " messages while the writers were behind" << std::endl;
+            }
         }
-        catch (json::parse_error&) {
-            std::cerr << "Invalid JSON message\n";
+        for (const auto& listener : listeners) {
+            print_summary(*listener, options);
         }
     }
 
-    CLOSE_SOCKET(sock);
 #ifdef _WIN32
     WSACleanup();
 #endif
 }
 
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " <ip> <port> [options]\n"
+              << "  --array-names <key>=<name>,...  name the elements of a numeric array, e.g. location=x,y,z\n"
+              << "  --keep-arrays                   write arrays as a single json text column\n"
+              << "  --merge-sources                 write all senders to one csv with a SourceAddress column\n"
+              << "  --buffer-size <bytes>           receive buffer per datagram (default 65536)\n"
+              << "  --batch <n>                     datagrams received per system call (default 16)\n"
+              << "  --seq-field <key>               sequence number field, to count loss and reordering per sender\n"
+              << "  --time-field <key>              send time field (since epoch), to measure one-way latency\n"
+              << "  --time-unit s|ms|us             unit of the send time field (default ms)\n"
+              << "  --field <json pointer>          only decode and log this field, e.g. /location (repeatable)\n"
+              << "  --listen <ip>:<port>            also listen on this port (repeatable)\n"
+              << "  --join <group>:<port>[@<ip>]    also receive this multicast group, on the interface with this address (repeatable)\n"
+              << "  --tcp <ip>:<port>               also accept TCP connections carrying a stream of messages (repeatable)\n"
+              << "  --framing newline|length        TCP messages are lines (NDJSON) or 4-byte big endian length prefixed (default newline)\n"
+              << "  --max-message <bytes>           largest TCP message, larger ones are skipped (default 1048576)\n"
+              << "  --writers <n>                   threads flattening and writing csv for all feeds, 0 for the receiving thread (default 1)\n"
+              << "  --status <seconds>              print rates, errors and latest message per feed this often, 0 for never (default 1)\n"
+              << "  --dump-every <n>                print every n-th message in full (default 0, never)" << std::endl;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <ip> <port>" << std::endl;
+    if (argc < 3) {
+        print_usage(argv[0]);
         return 1;
     }
 
-    std::string ip = argv[1];
-    int port = std::stoi(argv[2]);
+    std::vector<Binding> bindings{Binding{argv[1], std::stoi(argv[2])}};
+    size_t writer_threads = 1;
+    double status_seconds = 0;
+    util::Framing framing = util::Framing::newline;
+    size_t max_message = 1 << 20;
+
+    util::ListenerOptions options;
+#ifdef VERBOSE
+    options.verbose = true;
+    status_seconds = 1;
+#endif
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--keep-arrays") {
+            options.expand_arrays = false;
+        } else if (arg == "--merge-sources") {
+            options.merge_sources = true;
+        } else if (arg == "--buffer-size" && i + 1 < argc) {
+            options.buffer_size = std::min<size_t>(std::stoul(argv[++i]), util::max_datagram_size + 1);
+        } else if (arg == "--batch" && i + 1 < argc) {
+            options.batch = std::max<size_t>(std::stoul(argv[++i]), 1);
+        } else if (arg == "--field" && i + 1 < argc) {
+            options.projection.push_back(argv[++i]);
+            try {
+                util::Projection().add(options.projection.back());
+            } catch (json::exception& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if ((arg == "--listen" || arg == "--join" || arg == "--tcp") && i + 1 < argc) {
+            Binding binding;
+            if (!parse_binding(argv[++i], arg == "--join", binding)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            binding.tcp = arg == "--tcp";
+            bindings.push_back(binding);
+        } else if (arg == "--max-message" && i + 1 < argc) {
+            max_message = std::stoul(argv[++i]);
+        } else if (arg == "--framing" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "newline") {
+                framing = util::Framing::newline;
+            } else if (name == "length") {
+                framing = util::Framing::length;
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--status" && i + 1 < argc) {
+            status_seconds = std::stod(argv[++i]);
+        } else if (arg == "--dump-every" && i + 1 < argc) {
+            options.dump_every = std::stoul(argv[++i]);
+        } else if (arg == "--writers" && i + 1 < argc) {
+            writer_threads = std::stoul(argv[++i]);
+        } else if (arg == "--seq-field" && i + 1 < argc) {
+            options.seq_field = argv[++i];
+        } else if (arg == "--time-field" && i + 1 < argc) {
+            options.time_field = argv[++i];
+        } else if (arg == "--time-unit" && i + 1 < argc) {
+            std::string unit = argv[++i];
+            if (unit == "s") {
+                options.time_unit_us = 1000000;
+            } else if (unit == "ms") {
+                options.time_unit_us = 1000;
+            } else if (unit == "us") {
+                options.time_unit_us = 1;
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--array-names" && i + 1 < argc) {
+            std::string spec = argv[++i];
+            size_t eq = spec.find('=');
+            if (eq == std::string::npos) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            std::vector<std::string> names;
+            std::stringstream ss(spec.substr(eq + 1));
+            for (std::string name; std::getline(ss, name, ',');) {
+                names.push_back(name);
+            }
+            options.array_names.emplace_back(spec.substr(0, eq), names);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
 
-    udp_listener(ip, port);
+    options.keep_latest = status_seconds > 0;
+    udp_listener(bindings, options, framing, max_message, writer_threads, status_seconds);
     return 0;
 }
\ No newline at end of file
@@ -4,32 +4,18 @@
 #include <chrono>
 #include <string>
 #include <cstring>
+#include <fstream>
+#include <vector>
+#include <algorithm>
 
-#ifdef _WIN32
-    #include <WinSock2.h>
-    #include <WS2tcpip.h>
-    #pragma comment(lib, "Ws2_32.lib")
-
-    typedef SOCKET SocketType;
-    #define INVALID_SOCK INVALID_SOCKET
-    #define CLOSE_SOCKET closesocket
-    #define SOCKET_ERROR_CODE SOCKET_ERROR
-#else // _WIN32, UNIX-like system: i.e. Linux
-    #include <sys/socket.h>
-    #include <netinet/in.h>
-    #include <arpa/inet.h>
-    #include <sys/stat.h>
-    #include <unistd.h>
-
-    typedef int SocketType;
-    #define INVALID_SOCK -1
-    #define CLOSE_SOCKET close
-    #define SOCKET_ERROR_CODE -1
-#endif
+#include "socket.h"
 
 #include "nlohmann/json.hpp"
 using json = nlohmann::json;
 
+#include "payload.h"
+#include "load_generator.h"
+
 #define VERBOSE
 // #undef VERBOSE
 json create_dummy_message() {
@@ -57,7 +43,90 @@ json create_dummy_message() {
     };
 }
 
-void udp_sample_talker(const std::string& ip, int port) {
+struct TalkerOptions {
+    util::Encoding encoding = util::Encoding::json;
+    bool load = false;                      // load generator mode, enabled by any of the options below
+    util::LoadOptions load_options;
+    std::string template_file;              // json message(s) to send, one per line or a single document
+    std::string replay_file;                // csv written by the listener, e.g. ble.csv
+    size_t payload_size = 0;                // pad payloads up to this many bytes
+    std::string seq_field = "seq";
+    std::string time_field = "sentTimeUs";
+};
+
+std::vector<json> load_template_messages(const std::string& filename) {
+    std::ifstream file(filename);
+    std::stringstream content;
+    content << file.rdbuf();
+    json document = json::parse(content.str(), nullptr, false);
+    if (!document.is_discarded()) {
+        return {document};
+    }
+    // json lines
+    std::vector<json> messages;
+    std::string line;
+    content.clear();
+    content.seekg(0);
+    while (std::getline(content, line)) {
+        if (line.find_first_not_of(" \t\r") != std::string::npos) {
+            messages.push_back(json::parse(line));
+        }
+    }
+    return messages;
+}
+
+void udp_load_generator(const sockaddr_in& server_addr, const TalkerOptions& options) {
+    std::vector<json> messages;
+    try {
+        if (!options.replay_file.empty()) {
+            messages = util::load_csv_messages(options.replay_file);
+        } else if (!options.template_file.empty()) {
+            messages = load_template_messages(options.template_file);
+        } else {
+            messages.push_back(create_dummy_message());
+        }
+    } catch (json::parse_error& e) {
+        std::cerr << "Invalid template: " << e.what() << "\n";
+        return;
+    }
+    if (messages.empty()) {
+        std::cerr << "No messages to send\n";
+        return;
+    }
+
+    std::vector<util::PayloadTemplate> templates;
+    for (const auto& message : messages) {
+        templates.push_back(util::make_template(message, options.encoding, options.seq_field, options.time_field, options.payload_size));
+    }
+    std::cout << "Sending " << templates.size() << " template(s), " << templates.front().bytes.size() << " bytes each (first)"
+              << " from " << options.load_options.threads << " thread(s)";
+    if (options.load_options.rate > 0) {
+        std::cout << " at " << options.load_options.rate << " msg/s";
+    }
+    std::cout << std::endl;
+
+    util::LoadGenerator generator(server_addr, std::move(templates), options.load_options);
+    auto start = std::chrono::steady_clock::now();
+    generator.start();
+
+    // report the achieved rate once per second
+    uint64_t last_sent = 0, last_bytes = 0;
+    while (generator.running()) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t sent = generator.sent(), bytes = generator.bytes();
+        std::cout << "Sent " << sent - last_sent << " msg/s, " << (bytes - last_bytes) / 1000.0 << " kB/s"
+                  << " (failed: " << generator.failed() << ")" << std::endl;
+        last_sent = sent;
+        last_bytes = bytes;
+    }
+    generator.join();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Sent " << generator.sent() << " messages in " << elapsed << " s: "
+              << generator.sent() / elapsed << " msg/s (failed: " << generator.failed() << ")" << std::endl;
+}
+
+void udp_sample_talker(const std::string& ip, int port, const TalkerOptions& options) {
 #ifdef _WIN32
     WSADATA wsaData;
     if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
@@ -66,15 +135,6 @@ void udp_sample_talker(const std::string& ip, int port) {
     }
 #endif
 
-    SocketType sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock == INVALID_SOCK) {
-        std::cerr << "Failed to create socket\n";
-#ifdef _WIN32
-        WSACleanup();
-#endif
-        return;
-    }
-
     sockaddr_in server_addr;
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
@@ -86,11 +146,28 @@ void udp_sample_talker(const std::string& ip, int port) {
     server_addr.sin_addr.s_addr = inet_addr(ip.c_str());
 #endif
 
+    if (options.load) {
+        udp_load_generator(server_addr, options);
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return;
+    }
+
+    SocketType sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock == INVALID_SOCK) {
+        std::cerr << "Failed to create socket\n";
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return;
+    }
+
     while (true) {
         json message = create_dummy_message();
-        std::string json_message = message.dump();
+        std::vector<uint8_t> payload = util::encode_payload(message, options.encoding);
 
-        int sent = sendto(sock, json_message.c_str(), static_cast<int>(json_message.length()), 0, (struct sockaddr*)&server_addr, sizeof(server_addr));
+        int sent = sendto(sock, reinterpret_cast<const char*>(payload.data()), static_cast<int>(payload.size()), 0, (struct sockaddr*)&server_addr, sizeof(server_addr));
 
         if (sent == SOCKET_ERROR_CODE) {
             std::cerr << "Failed to send\n";
@@ -110,15 +187,72 @@ void udp_sample_talker(const std::string& ip, int port) {
 #endif
 }
 
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " <ip> <port> [options]\n"
+              << "  --encoding json|cbor|msgpack  payload encoding (default json)\n"
+              << "load generator mode:\n"
+              << "  --rate <msg/s>                target rate over all threads (default: as fast as possible)\n"
+              << "  --threads <n>                 sender threads, each with its own source port (default 1)\n"
+              << "  --batch <n>                   messages per sendmmsg (default 1)\n"
+              << "  --duration <s>                stop after this many seconds\n"
+              << "  --template <file>             json message(s) to send, one per line or a single document\n"
+              << "  --replay <csv>                replay the rows of a listener csv, e.g. ble.csv\n"
+              << "  --payload-size <bytes>        pad payloads up to this size\n"
+              << "  --seq-field <name>            sequence number field (default seq, empty to omit)\n"
+              << "  --time-field <name>           send time field, us since epoch (default sentTimeUs, empty to omit)" << std::endl;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <ip> <port>" << std::endl;
+    if (argc < 3) {
+        print_usage(argv[0]);
         return 1;
     }
 
     std::string ip = argv[1];
     int port = std::stoi(argv[2]);
 
-    udp_sample_talker(ip, port);
+    TalkerOptions options;
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--encoding") {
+            options.encoding = util::parse_encoding(value);
+            if (options.encoding == util::Encoding::unknown) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            continue;
+        }
+
+        options.load = true;
+        if (arg == "--rate") {
+            options.load_options.rate = std::stod(value);
+        } else if (arg == "--threads") {
+            options.load_options.threads = std::max(std::stoi(value), 1);
+        } else if (arg == "--batch") {
+            options.load_options.batch = std::max<size_t>(std::stoul(value), 1);
+        } else if (arg == "--duration") {
+            options.load_options.duration = std::stod(value);
+        } else if (arg == "--template") {
+            options.template_file = value;
+        } else if (arg == "--replay") {
+            options.replay_file = value;
+        } else if (arg == "--payload-size") {
+            options.payload_size = std::stoul(value);
+        } else if (arg == "--seq-field") {
+            options.seq_field = value;
+        } else if (arg == "--time-field") {
+            options.time_field = value;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    udp_sample_talker(ip, port, options);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,222 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+using json = nlohmann::json;
+
+#include "arena.h"
+#include "key_table.h"
+#include "json_reader.h"
+#include "payload.h"
+#include "csv_writer.h"
+
+// Writes the messages of a json lines fixture to csv twice, flattened in place by JsonRowReader and
+// decoded by nlohmann then flattened by flatten_json, as the listener does, and compares both with
+// the expected csv: the schema segments one after the other. Covers csv escaping, number formatting,
+// the int64/uint64 extremes, repeated keys, arrays of varying length and a leading UTF-8 BOM, which
+// detect_encoding must also take for json. With arrays kept whole, the csv is also compared with the
+// baseline listener's formatting (namespace baseline), segment by segment.
+//
+// Usage: golden_csv <fixture.jsonl> <expected.csv> <output dir>
+
+std::string read_file(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+// Writes every line of `lines` to `csv` and returns its segments, concatenated; empty when a line is rejected.
+template <typename Flatten>
+std::string write_csv(const std::vector<std::string>& lines, const std::filesystem::path& csv, Flatten flatten) {
+    util::KeyTable keys;
+    std::vector<util::Cell> row;
+    util::Arena scratch;
+    util::SchemaCsvWriter writer(csv.string());
+    for (const std::string& line : lines) {
+        scratch.reset();
+        std::fill(row.begin(), row.end(), util::Cell());
+        try {
+            flatten(line, keys, row, scratch);
+        } catch (json::exception& e) {
+            std::cerr << csv.filename().string() << ": " << e.what() << "\n";
+            return std::string();
+        }
+        writer.write(keys, row);
+    }
+    writer.flush();
+    std::string segments = read_file(csv);
+    for (size_t version = 2; version <= writer.version(); ++version) {
+        std::filesystem::path segment = csv;
+        segment.replace_filename(csv.stem().string() + "_v" + std::to_string(version) + csv.extension().string());
+        segments += read_file(segment);
+    }
+    return segments;
+}
+
+// The baseline listener's formatting, kept as it was (writing to any stream) to check the csv against.
+namespace baseline {
+
+void flatten_json(const json& j, std::string prefix, json& result) {
+    for (auto& el : j.items()) {
+        // concatenate the key with the parent structure key using dot
+        std::string new_key = prefix.empty() ? el.key() : prefix + "." + el.key();
+        if (el.value().is_object()) {
+            flatten_json(el.value(), new_key, result);
+        } else {
+            result[new_key] = el.value();
+        }
+    }
+}
+
+std::string escape_csv(const std::string& str) {
+    std::ostringstream oss;
+    oss << '"';
+    for (auto c : str) {
+        if (c == '"') {
+            oss << '"' << '"';
+        } else {
+            oss << c;
+        }
+    }
+    oss << '"';
+    return oss.str();
+}
+
+void write_csv_line(std::ostream& file, const json& j, const std::vector<std::string>& keys) {
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (j.contains(keys[i])) {
+            const auto& value = j[keys[i]];
+            if (value.is_string()) {
+                file << escape_csv(value.get<std::string>());
+            } else if (value.is_number() || value.is_boolean()) {
+                file << value;
+            } else {
+                file << escape_csv(value.dump());
+            }
+        } else {
+            // Write an empty string if the key is not found
+            file << "";
+        }
+        if (i < keys.size() - 1) file << ",";
+    }
+    file << "\n";
+}
+
+// Formats the lines as the baseline listener would, with the header and columns of each segment in
+// `schema` (a SchemaCsvWriter sidecar) in place of its single header from the first message.
+std::string write_csv(const std::vector<std::string>& lines, const std::filesystem::path& schema) {
+    std::vector<json> segments;
+    std::ifstream sidecar(schema);
+    for (std::string entry; std::getline(sidecar, entry);) {
+        segments.push_back(json::parse(entry));
+    }
+    std::ostringstream csv;
+    for (size_t s = 0; s < segments.size(); ++s) {
+        std::vector<std::string> header = segments[s]["columns"].get<std::vector<std::string>>();
+        for (size_t i = 0; i < header.size(); i++) {
+            csv << escape_csv(header[i]);
+            if (i < header.size() - 1) {
+                csv << ",";
+            }
+        }
+        csv << "\n";
+        size_t end = s + 1 < segments.size() ? segments[s + 1]["first_row"].get<size_t>() : lines.size();
+        for (size_t row = segments[s]["first_row"].get<size_t>(); row < end; ++row) {
+            json flattened;
+            flatten_json(json::parse(lines[row]), "", flattened);
+            write_csv_line(csv, flattened, header);
+        }
+    }
+    return csv.str();
+}
+
+}  // namespace baseline
+
+// Prints the first line where `actual` differs from `expected`.
+bool compare(const std::string& name, const std::string& actual, const std::string& expected) {
+    if (actual == expected) {
+        return true;
+    }
+    std::istringstream a(actual), e(expected);
+    std::string actual_line, expected_line;
+    for (size_t line = 1;; ++line) {
+        bool more_actual = static_cast<bool>(std::getline(a, actual_line));
+        bool more_expected = static_cast<bool>(std::getline(e, expected_line));
+        if (!more_actual && !more_expected) {
+            break;
+        }
+        if (actual_line != expected_line || more_actual != more_expected) {
+            std::cerr << name << ": line " << line << " differs\n"
+                      << "  expected: " << (more_expected ? expected_line : "(end of file)") << "\n"
+                      << "  actual:   " << (more_actual ? actual_line : "(end of file)") << "\n";
+            return false;
+        }
+    }
+    std::cerr << name << ": differs from the expected csv\n";
+    return false;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 4) {
+        std::cerr << "Usage: " << argv[0] << " <fixture.jsonl> <expected.csv> <output dir>" << std::endl;
+        return 2;
+    }
+    std::vector<std::string> lines;
+    std::ifstream fixture(argv[1]);
+    for (std::string line; std::getline(fixture, line);) {
+        if (!line.empty()) {
+            lines.push_back(line);
+        }
+    }
+    if (lines.empty()) {
+        std::cerr << "No messages in " << argv[1] << std::endl;
+        return 2;
+    }
+    bool ok = true;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        if (util::detect_encoding(lines[i].data(), lines[i].size()) != util::Encoding::json) {
+            std::cerr << "detect_encoding: line " << i + 1 << " not taken for json\n";
+            ok = false;
+        }
+    }
+    const std::string expected = read_file(argv[2]);
+    const std::filesystem::path dir = argv[3];
+    std::filesystem::create_directories(dir);
+
+    json message;  // the cells refer to it until the row is written
+    auto decoded = [&message](const std::string& line, util::KeyTable& keys, std::vector<util::Cell>& row, util::Arena& scratch) {
+        message = json::parse(line);
+        util::flatten_json(message, keys, util::KeyTable::root, row, scratch);
+    };
+    util::JsonRowReader reader;
+    auto in_place = [&reader, &message](const std::string& line, util::KeyTable& keys, std::vector<util::Cell>& row, util::Arena& scratch, bool expand_arrays) {
+        // as Feed::write does, a message with a repeated key goes to nlohmann
+        util::KeyTable::Mark mark = keys.mark();
+        if (!reader.read(line.data(), line.size(), keys, row, scratch, expand_arrays)) {
+            keys.rollback(mark);
+            std::fill(row.begin(), row.end(), util::Cell());
+            message = json::parse(line);
+            util::flatten_json(message, keys, util::KeyTable::root, row, scratch, expand_arrays);
+        }
+    };
+    auto expanded = [&in_place](const std::string& line, util::KeyTable& keys, std::vector<util::Cell>& row, util::Arena& scratch) {
+        in_place(line, keys, row, scratch, true);
+    };
+    auto kept = [&in_place](const std::string& line, util::KeyTable& keys, std::vector<util::Cell>& row, util::Arena& scratch) {
+        in_place(line, keys, row, scratch, false);
+    };
+
+    ok = compare("json_reader", write_csv(lines, dir / "golden_json_reader.csv", expanded), expected) && ok;
+    ok = compare("flatten_json", write_csv(lines, dir / "golden_flatten_json.csv", decoded), expected) && ok;
+    // with arrays kept whole (--keep-arrays) every row is the baseline listener's, byte for byte
+    const std::string kept_csv = write_csv(lines, dir / "golden_kept_arrays.csv", kept);
+    ok = compare("baseline", kept_csv, baseline::write_csv(lines, dir / "golden_kept_arrays.schema.jsonl")) && ok;
+    std::cout << (ok ? "golden csv: ok" : "golden csv: FAILED") << std::endl;
+    return ok ? 0 : 1;
+}